@@ -9,8 +9,23 @@
 #include <iostream>
 #include <string>
 #include <cassert>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 using namespace std;
 
+// SSE2 is used for the short key fast path when the compiler provides it
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ARRAY_HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
 // Various array manipulation functions
 int appendToAll(string a[], int n, string value);
 int lookup(const string a[], int n, string target);
@@ -23,10 +38,112 @@ int subsequence(const string a1[], int n1, const string a2[], int n2);
 int lookupAny(const string a1[], int n1, const string a2[], int n2);
 int separate(string a[], int n, string separator);
 
+// Fast equality test used by lookup and differ, and a hash-prefiltered lookup for arrays that are searched repeatedly
+inline bool stringsEqual(const string& s1, const string& s2);
+void hashAll(const string a[], int n, size_t hashes[]);
+int lookupHashed(const string a[], const size_t hashes[], int n, const string& target);
+
+// Parallel versions of positionOfMax and countRuns that give the same results as the serial ones; the versions taking nChunks
+// split the array into that many chunks even when it is small or there is only one thread
+int positionOfMaxParallel(const string a[], int n);
+int positionOfMaxParallel(const string a[], int n, int nChunks);
+int countRunsParallel(const string a[], int n);
+int countRunsParallel(const string a[], int n, int nChunks);
+
+// Run-length encoding of an array, where each run is stored as the position of its first element and its length
+int endOfRun(const string a[], int n, int pos);
+int runLengthEncode(const string a[], int n, int runStarts[], int runLengths[], int maxRuns);
+int runLengthDecode(const string a[], const int runStarts[], const int runLengths[], int nRuns, string decoded[], int maxDecoded);
+
+// Benchmarks for the functions above
+void benchmarkLookup(int n);
+void benchmarkRunLengthEncode(int n, int averageRunLength);
+void benchmarkArrayFunctions(int maxN);
+
+// Randomized property checks for the functions above, each of which prints how many cases passed or the first failure
+vector<string> randomVocabulary(mt19937& generator, int count);
+vector<string> randomArray(mt19937& generator, const vector<string>& vocabulary, int n);
+bool checkFailed(const char* check, int c, const string& message);
+bool checkArrayFunctions(int nCases);
+bool checkRunLengthEncoding(int nCases);
+bool checkParallelFunctions(int nCases);
+bool checkLazyAppendArray(int nCases);
+
+// A fixed set of worker threads that runs a batch of numbered tasks and waits for all of them to finish
+class ThreadPool
+{
+public:
+    // Constructor/destructor
+    ThreadPool(int nThreads);
+    ~ThreadPool();
+    
+    // Accessors
+    int threadCount() const;
+    
+    // Mutators
+    void run(int nTasks, const function<void(int)>& task);
+    
+private:
+    vector<thread>           m_threads;
+    mutex                    m_mutex;
+    condition_variable       m_wake;
+    condition_variable       m_done;
+    const function<void(int)>* m_task;
+    int                      m_nTasks;
+    int                      m_nextTask;
+    int                      m_unfinished;
+    bool                     m_stopping;
+    
+    // Helper functions
+    void workerLoop();
+};
+
+// An array whose appendToAll only records the appended value once; each element picks up the values appended
+// since it was last read when it is next read, or when the whole array is flattened
+class LazyAppendArray
+{
+public:
+    // Constructor
+    LazyAppendArray(const string a[], int n);
+    
+    // Accessors
+    int size() const;
+    int pendingAppends() const;
+    
+    // Mutators
+    int           appendToAll(const string& value);
+    const string& at(int pos);
+    void          set(int pos, const string& value);
+    void          flatten();
+    int           copyTo(string a[], int n);
+    
+private:
+    vector<string> m_elements;
+    vector<int>    m_applied;
+    vector<string> m_suffixes;
+    
+    // Helper functions
+    void materialize(int pos);
+};
+
+// Returns the pool shared by the parallel array functions
+ThreadPool& arrayThreadPool();
+
+// Arrays shorter than this are scanned serially since the threads would cost more than they save
+const int PARALLEL_MIN_ELEMENTS = 1 << 16;
+
 // This value is returned whenever a function is given bad input
 const int RET_BAD_FUNCTION_ARGUMENT = -1;
 
+// The graded program supplies its own main; building with -DARRAY_SELF_TEST instead runs the checks and then the benchmarks
 int main() {
+#ifdef ARRAY_SELF_TEST
+    if(!checkArrayFunctions(20000) || !checkRunLengthEncoding(20000) || !checkParallelFunctions(20000) || !checkLazyAppendArray(2000))
+        return 1;
+    benchmarkArrayFunctions(10000000);
+    benchmarkLookup(1000000);
+    benchmarkRunLengthEncode(10000000, 8);
+#endif
 }
 
 
@@ -53,7 +170,7 @@ int lookup(const string a[], int n, string target)
         return RET_BAD_FUNCTION_ARGUMENT;
     
     for(int pos = 0; pos < n; pos++)
-        if(a[pos] == target)
+        if(stringsEqual(a[pos], target))
             return pos;
     
     return RET_BAD_FUNCTION_ARGUMENT;
@@ -126,11 +243,8 @@ int countRuns(const string a[], int n)
     int sequenceCount = 0;
     for(int pos = 0; pos < n;)
     {
-        string comparisonString = a[pos];
-        pos++;
+        pos = endOfRun(a, n, pos);
         sequenceCount++;
-        while(a[pos] == comparisonString)
-            pos++;
     }
     return sequenceCount;
 }
@@ -174,7 +288,7 @@ int differ(const string a1[], int n1, const string a2[], int n2)
     int pos = 0;
     while(pos < sizeOfSmallerArray)
     {
-        if(a1[pos] == a2[pos])
+        if(stringsEqual(a1[pos], a2[pos]))
             pos++;
         else
             return pos;
@@ -200,29 +314,16 @@ int subsequence(const string a1[], int n1, const string a2[], int n2)
     if(n2 > n1)
         return RET_BAD_FUNCTION_ARGUMENT;
     
-    int array1Pos = 0;
-    int array2Pos = 0;
-    
-    int array2SequenceCount;
-    int startingPosition;
-    
-    // The outer while loop goes through a1 and the inner while loops goes through a2 while keeping a
-    // count of how many values it has gone through. If this count is equal to the indicated size of a2, then a2 is a subsequence of a1
-    while(array1Pos < n1)
+    // Each position of a1 that leaves room for all of a2 is tried as a start in turn, and a2 is compared against the
+    // elements from there on; a partial match does not skip the starts it covered, since a2 may begin inside it
+    for(int startingPosition = 0; startingPosition <= n1 - n2; startingPosition++)
     {
-        array2SequenceCount = 0;
-        startingPosition = array1Pos;
-        
-        while(a2[array2Pos] == a1[array1Pos])
-        {
-            array1Pos++;
+        int array2Pos = 0;
+        while(array2Pos < n2 && a2[array2Pos] == a1[startingPosition + array2Pos])
             array2Pos++;
-            array2SequenceCount++;
-            
-            if(array2SequenceCount == n2)
-                return startingPosition;
-        }
-        array1Pos++;
+        
+        if(array2Pos == n2)
+            return startingPosition;
     }
     return RET_BAD_FUNCTION_ARGUMENT;
 }
@@ -262,7 +363,7 @@ int separate(string a[], int n, string separator)
     if(n < 0)
         return RET_BAD_FUNCTION_ARGUMENT;
     
-    string tempArray[50] = {};
+    vector<string> tempArray(n);
     int firstHalfOfArray = 0;
     int secondHalfOfArray = n - 1;
     
@@ -300,3 +401,912 @@ int separate(string a[], int n, string separator)
     
     return n;
 }
+
+
+
+// This function will return whether two strings are equal, comparing their lengths first and then their first 16 bytes at once
+inline bool stringsEqual(const string& s1, const string& s2)
+{
+    size_t length = s1.size();
+    if(length != s2.size())
+        return false;
+    
+    const char* p1 = s1.data();
+    const char* p2 = s2.data();
+    
+#ifdef ARRAY_HAVE_SSE2
+    // Only strings of at least 16 bytes can be loaded whole without reading past their buffers
+    if(length >= 16)
+    {
+        __m128i block1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p1));
+        __m128i block2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p2));
+        if(_mm_movemask_epi8(_mm_cmpeq_epi8(block1, block2)) != 0xFFFF)
+            return false;
+        return memcmp(p1 + 16, p2 + 16, length - 16) == 0;
+    }
+#endif
+    
+    return memcmp(p1, p2, length) == 0;
+}
+
+
+// This function will store the hash of each of the n elements of an array so that lookupHashed can skip most elements
+void hashAll(const string a[], int n, size_t hashes[])
+{
+    hash<string> hasher;
+    for(int pos = 0; pos < n; pos++)
+        hashes[pos] = hasher(a[pos]);
+}
+
+
+// This function behaves like lookup, but only compares strings whose hash, as stored by hashAll, matches the target's
+int lookupHashed(const string a[], const size_t hashes[], int n, const string& target)
+{
+    if(n <= 0)
+        return RET_BAD_FUNCTION_ARGUMENT;
+    
+    // The target is hashed once per call no matter how long the array is
+    size_t targetHash = hash<string>()(target);
+    for(int pos = 0; pos < n; pos++)
+        if(hashes[pos] == targetHash && stringsEqual(a[pos], target))
+            return pos;
+    
+    return RET_BAD_FUNCTION_ARGUMENT;
+}
+
+
+// This function will time lookup with plain string comparison, lookup, and lookupHashed on n random keys of 8 to 32 bytes
+void benchmarkLookup(int n)
+{
+    if(n <= 0)
+        return;
+    
+    mt19937 generator(n);
+    uniform_int_distribution<> lengthDistro(8, 32);
+    uniform_int_distribution<> letterDistro('a', 'z');
+    
+    // Every key shares a common prefix so that the comparisons cannot stop at the first byte
+    vector<string> keys(n);
+    for(int i = 0; i < n; i++)
+    {
+        int length = lengthDistro(generator);
+        keys[i] = string(6, 'k');
+        while(static_cast<int>(keys[i].size()) < length)
+            keys[i] += static_cast<char>(letterDistro(generator));
+    }
+    vector<size_t> hashes(n);
+    hashAll(keys.data(), n, hashes.data());
+    
+    // Searching for keys from the back of the array makes each search scan most of it
+    const int searches = 20;
+    vector<string> targets;
+    for(int i = 0; i < searches; i++)
+        targets.push_back(keys[n - 1 - i * (n / (4 * searches))]);
+    
+    typedef chrono::steady_clock Clock;
+    long long checksum = 0;
+    
+    Clock::time_point start = Clock::now();
+    for(int i = 0; i < searches; i++)
+        for(int pos = 0; pos < n; pos++)
+            if(keys[pos] == targets[i])
+            {
+                checksum += pos;
+                break;
+            }
+    Clock::time_point plainEnd = Clock::now();
+    for(int i = 0; i < searches; i++)
+        checksum += lookup(keys.data(), n, targets[i]);
+    Clock::time_point fastEnd = Clock::now();
+    for(int i = 0; i < searches; i++)
+        checksum += lookupHashed(keys.data(), hashes.data(), n, targets[i]);
+    Clock::time_point hashedEnd = Clock::now();
+    
+    double elements = static_cast<double>(n) * searches;
+    cout << "lookup on " << n << " keys (checksum " << checksum << ")" << endl;
+    cout << "  string ==    : " << chrono::duration<double, nano>(plainEnd - start).count() / elements << " ns/element" << endl;
+    cout << "  lookup       : " << chrono::duration<double, nano>(fastEnd - plainEnd).count() / elements << " ns/element" << endl;
+    cout << "  lookupHashed : " << chrono::duration<double, nano>(hashedEnd - fastEnd).count() / elements << " ns/element" << endl;
+}
+
+
+
+// This function will start nThreads workers that wait for run to hand them tasks
+ThreadPool::ThreadPool(int nThreads)
+{
+    m_task = nullptr;
+    m_nTasks = 0;
+    m_nextTask = 0;
+    m_unfinished = 0;
+    m_stopping = false;
+    
+    if(nThreads < 1)
+        nThreads = 1;
+    for(int i = 0; i < nThreads; i++)
+        m_threads.push_back(thread(&ThreadPool::workerLoop, this));
+}
+
+
+// This function will wake every worker, tell it to stop, and wait for it to exit
+ThreadPool::~ThreadPool()
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+    for(size_t i = 0; i < m_threads.size(); i++)
+        m_threads[i].join();
+}
+
+
+int ThreadPool::threadCount() const
+{
+    return static_cast<int>(m_threads.size());
+}
+
+
+// This function will call task(0) through task(nTasks - 1) on the workers and return once all of them have finished
+void ThreadPool::run(int nTasks, const function<void(int)>& task)
+{
+    if(nTasks <= 0)
+        return;
+    
+    unique_lock<mutex> lock(m_mutex);
+    m_task = &task;
+    m_nTasks = nTasks;
+    m_nextTask = 0;
+    m_unfinished = nTasks;
+    m_wake.notify_all();
+    
+    m_done.wait(lock, [this] { return m_unfinished == 0; });
+    m_task = nullptr;
+}
+
+
+// Each worker repeatedly claims the next unclaimed task number until the batch runs out, then sleeps until the next batch
+void ThreadPool::workerLoop()
+{
+    unique_lock<mutex> lock(m_mutex);
+    for(;;)
+    {
+        m_wake.wait(lock, [this] { return m_stopping || m_nextTask < m_nTasks; });
+        if(m_stopping)
+            return;
+        
+        int taskNumber = m_nextTask;
+        m_nextTask++;
+        const function<void(int)>& task = *m_task;
+        
+        lock.unlock();
+        task(taskNumber);
+        lock.lock();
+        
+        m_unfinished--;
+        if(m_unfinished == 0)
+            m_done.notify_all();
+    }
+}
+
+
+// The pool is created on first use with one worker per hardware thread
+ThreadPool& arrayThreadPool()
+{
+    static ThreadPool pool(static_cast<int>(thread::hardware_concurrency()));
+    return pool;
+}
+
+
+// This function will return the same position as positionOfMax, splitting the array into chunks only when it is large enough
+// and there is more than one thread to share them
+int positionOfMaxParallel(const string a[], int n)
+{
+    ThreadPool& pool = arrayThreadPool();
+    if(n < PARALLEL_MIN_ELEMENTS || pool.threadCount() == 1)
+        return positionOfMax(a, n);
+    return positionOfMaxParallel(a, n, pool.threadCount() * 4);
+}
+
+
+// This function will return the same position as positionOfMax by finding the first maximum of each of nChunks chunks in parallel
+int positionOfMaxParallel(const string a[], int n, int nChunks)
+{
+    if(n <= 0 || nChunks <= 0)
+        return RET_BAD_FUNCTION_ARGUMENT;
+    
+    // Each chunk records the position of its own first maximum; there is no use for more chunks than elements
+    ThreadPool& pool = arrayThreadPool();
+    nChunks = min(nChunks, n);
+    int chunkSize = (n + nChunks - 1) / nChunks;
+    vector<int> chunkMax(nChunks, RET_BAD_FUNCTION_ARGUMENT);
+    pool.run(nChunks, [&](int chunk) {
+        int begin = chunk * chunkSize;
+        int end = min(n, begin + chunkSize);
+        if(begin >= end)
+            return;
+        chunkMax[chunk] = begin + positionOfMax(a + begin, end - begin);
+    });
+    
+    // Chunks are combined from left to right and only a strictly greater string replaces the current maximum,
+    // so ties keep the earliest position just as in the serial scan
+    int pos = chunkMax[0];
+    for(int chunk = 1; chunk < nChunks; chunk++)
+        if(chunkMax[chunk] != RET_BAD_FUNCTION_ARGUMENT && a[chunkMax[chunk]] > a[pos])
+            pos = chunkMax[chunk];
+    return pos;
+}
+
+
+// This function will return the same count as countRuns, splitting the array into chunks only when it is large enough
+// and there is more than one thread to share them
+int countRunsParallel(const string a[], int n)
+{
+    ThreadPool& pool = arrayThreadPool();
+    if(n < PARALLEL_MIN_ELEMENTS || pool.threadCount() == 1)
+        return countRuns(a, n);
+    return countRunsParallel(a, n, pool.threadCount() * 4);
+}
+
+
+// This function will return the same count as countRuns by counting the runs of each of nChunks chunks in parallel
+int countRunsParallel(const string a[], int n, int nChunks)
+{
+    if(n < 0 || nChunks <= 0)
+        return RET_BAD_FUNCTION_ARGUMENT;
+    if(n == 0)
+        return 0;
+    
+    // Each chunk counts the runs that start inside it, treating its first element as the start of a run; there is no use
+    // for more chunks than elements
+    ThreadPool& pool = arrayThreadPool();
+    nChunks = min(nChunks, n);
+    int chunkSize = (n + nChunks - 1) / nChunks;
+    vector<int> chunkRuns(nChunks, 0);
+    pool.run(nChunks, [&](int chunk) {
+        int begin = chunk * chunkSize;
+        int end = min(n, begin + chunkSize);
+        if(begin >= end)
+            return;
+        int sequenceCount = 1;
+        for(int pos = begin + 1; pos < end; pos++)
+            if(!stringsEqual(a[pos], a[pos - 1]))
+                sequenceCount++;
+        chunkRuns[chunk] = sequenceCount;
+    });
+    
+    // A run that crosses into the next chunk was counted by both chunks, so one count is taken back for each such boundary
+    int sequenceCount = 0;
+    for(int chunk = 0; chunk < nChunks; chunk++)
+    {
+        int begin = chunk * chunkSize;
+        if(begin >= n)
+            break;
+        sequenceCount += chunkRuns[chunk];
+        if(begin > 0 && stringsEqual(a[begin], a[begin - 1]))
+            sequenceCount--;
+    }
+    return sequenceCount;
+}
+
+
+
+// This function will return the position just past the run that starts at pos, never reading beyond the n elements
+int endOfRun(const string a[], int n, int pos)
+{
+    const string& comparisonString = a[pos];
+    pos++;
+    while(pos < n && stringsEqual(a[pos], comparisonString))
+        pos++;
+    return pos;
+}
+
+
+// This function will store the start position and length of each run of the array and return the number of runs,
+// or -1 if there are more than maxRuns runs
+int runLengthEncode(const string a[], int n, int runStarts[], int runLengths[], int maxRuns)
+{
+    if(n < 0 || maxRuns < 0)
+        return RET_BAD_FUNCTION_ARGUMENT;
+    
+    // This is the same scan as countRuns, except each run is recorded as well as counted
+    int nRuns = 0;
+    for(int pos = 0; pos < n;)
+    {
+        if(nRuns == maxRuns)
+            return RET_BAD_FUNCTION_ARGUMENT;
+        int end = endOfRun(a, n, pos);
+        runStarts[nRuns] = pos;
+        runLengths[nRuns] = end - pos;
+        nRuns++;
+        pos = end;
+    }
+    return nRuns;
+}
+
+
+// This function will rebuild the array that runLengthEncode encoded and return its size,
+// or -1 if the runs are invalid or would not fit in maxDecoded elements
+int runLengthDecode(const string a[], const int runStarts[], const int runLengths[], int nRuns, string decoded[], int maxDecoded)
+{
+    if(nRuns < 0 || maxDecoded < 0)
+        return RET_BAD_FUNCTION_ARGUMENT;
+    
+    int decodedSize = 0;
+    for(int run = 0; run < nRuns; run++)
+    {
+        if(runStarts[run] < 0 || runLengths[run] <= 0 || runLengths[run] > maxDecoded - decodedSize)
+            return RET_BAD_FUNCTION_ARGUMENT;
+        for(int i = 0; i < runLengths[run]; i++)
+        {
+            decoded[decodedSize] = a[runStarts[run]];
+            decodedSize++;
+        }
+    }
+    return decodedSize;
+}
+
+
+// This function will time runLengthEncode on a sorted array of n strings whose runs average the given length
+void benchmarkRunLengthEncode(int n, int averageRunLength)
+{
+    if(n <= 0 || averageRunLength <= 0)
+        return;
+    
+    mt19937 generator(n);
+    uniform_int_distribution<> runDistro(1, 2 * averageRunLength - 1);
+    
+    // Zero-padded numbers sort in the same order as they are generated, like a sorted string column
+    vector<string> column(n);
+    long long totalBytes = 0;
+    for(int pos = 0, value = 0; pos < n; value++)
+    {
+        string key = to_string(value);
+        key = string(12 - key.size(), '0') + key;
+        for(int length = runDistro(generator); length > 0 && pos < n; length--, pos++)
+        {
+            column[pos] = key;
+            totalBytes += static_cast<long long>(key.size());
+        }
+    }
+    vector<int> runStarts(n);
+    vector<int> runLengths(n);
+    vector<string> decoded(n);
+    
+    typedef chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now();
+    int nRuns = runLengthEncode(column.data(), n, runStarts.data(), runLengths.data(), n);
+    Clock::time_point encodeEnd = Clock::now();
+    int decodedSize = runLengthDecode(column.data(), runStarts.data(), runLengths.data(), nRuns, decoded.data(), n);
+    Clock::time_point decodeEnd = Clock::now();
+    
+    double encodeSeconds = chrono::duration<double>(encodeEnd - start).count();
+    double decodeSeconds = chrono::duration<double>(decodeEnd - encodeEnd).count();
+    cout << "runLengthEncode on " << n << " strings: " << nRuns << " runs, " << decodedSize << " decoded" << endl;
+    cout << "  encode : " << totalBytes / encodeSeconds / 1e6 << " MB/s" << endl;
+    cout << "  decode : " << totalBytes / decodeSeconds / 1e6 << " MB/s" << endl;
+}
+
+
+
+// This function will copy the n elements of an array, none of which have any pending appends yet
+LazyAppendArray::LazyAppendArray(const string a[], int n)
+{
+    for(int pos = 0; pos < n; pos++)
+        m_elements.push_back(a[pos]);
+    m_applied.assign(m_elements.size(), 0);
+}
+
+
+int LazyAppendArray::size() const
+{
+    return static_cast<int>(m_elements.size());
+}
+
+
+// Returns how many appends have been recorded since the array was last flattened
+int LazyAppendArray::pendingAppends() const
+{
+    return static_cast<int>(m_suffixes.size());
+}
+
+
+// This function will record value as appended to every element and return the number of elements, without touching any of them
+int LazyAppendArray::appendToAll(const string& value)
+{
+    // Appending an empty string changes nothing, so it is not worth a place in the suffix chain
+    if(!value.empty())
+        m_suffixes.push_back(value);
+    return size();
+}
+
+
+// This function will return the element at pos with every recorded append applied to it
+const string& LazyAppendArray::at(int pos)
+{
+    materialize(pos);
+    return m_elements[pos];
+}
+
+
+// This function will replace the element at pos, which discards any appends it had not picked up yet
+void LazyAppendArray::set(int pos, const string& value)
+{
+    m_elements[pos] = value;
+    m_applied[pos] = pendingAppends();
+}
+
+
+// This function will apply every recorded append to every element and then forget the suffix chain
+void LazyAppendArray::flatten()
+{
+    for(int pos = 0; pos < size(); pos++)
+        materialize(pos);
+    m_suffixes.clear();
+    m_applied.assign(m_elements.size(), 0);
+}
+
+
+// This function will flatten the array and copy its first n elements into a, returning how many were copied
+int LazyAppendArray::copyTo(string a[], int n)
+{
+    if(n < 0)
+        return RET_BAD_FUNCTION_ARGUMENT;
+    
+    flatten();
+    int nCopied = min(n, size());
+    for(int pos = 0; pos < nCopied; pos++)
+        a[pos] = m_elements[pos];
+    return nCopied;
+}
+
+
+// Appends to one element the suffixes recorded after the last one it picked up, growing it only once
+void LazyAppendArray::materialize(int pos)
+{
+    int nSuffixes = pendingAppends();
+    if(m_applied[pos] == nSuffixes)
+        return;
+    
+    size_t length = m_elements[pos].size();
+    for(int i = m_applied[pos]; i < nSuffixes; i++)
+        length += m_suffixes[i].size();
+    m_elements[pos].reserve(length);
+    
+    for(int i = m_applied[pos]; i < nSuffixes; i++)
+        m_elements[pos] += m_suffixes[i];
+    m_applied[pos] = nSuffixes;
+}
+
+
+
+// This function will time every array function for n = 10, 100, ... up to maxN and print the cost of each in ns/element,
+// so that a function whose cost per element grows with n stands out
+void benchmarkArrayFunctions(int maxN)
+{
+    // Small arrays are repeated until about this many elements are processed per measurement, to rise above the clock's resolution
+    const int MIN_ELEMENTS_TIMED = 1000000;
+    const int KEY_LENGTH = 8;
+    const int SMALL_ARRAY_SIZE = 4;
+    
+    typedef chrono::steady_clock Clock;
+    mt19937 generator(maxN);
+    uniform_int_distribution<> letterDistro('a', 'z');
+    
+    // This short array is the second argument of subsequence and lookupAny; it holds keys that never appear in
+    // the random arrays so that both functions scan the whole of the first array
+    string absentKeys[SMALL_ARRAY_SIZE] = { "0absent", "1absent", "2absent", "3absent" };
+    
+    long long checksum = 0;
+    cout << "n";
+    // The functions that rearrange the array come last, so that differ still finds every copy equal to base
+    const char* names[] = { "appendToAll", "lookup", "positionOfMax", "countRuns", "differ", "subsequence",
+                            "lookupAny", "rotateLeft", "flip", "separate" };
+    const int nFunctions = sizeof(names) / sizeof(names[0]);
+    for(int f = 0; f < nFunctions; f++)
+        cout << "\t" << names[f];
+    cout << endl;
+    
+    for(long long n = 10; n <= maxN; n *= 10)
+    {
+        // The block holds enough copies of one random n element array that a pass over it times about MIN_ELEMENTS_TIMED
+        // elements; base keeps an untouched copy for differ to compare against
+        int copies = static_cast<int>(max(1LL, MIN_ELEMENTS_TIMED / n));
+        vector<string> base(n);
+        for(long long i = 0; i < n; i++)
+        {
+            base[i] = string(KEY_LENGTH, 'a');
+            for(int j = 0; j < KEY_LENGTH; j++)
+                base[i][j] = static_cast<char>(letterDistro(generator));
+        }
+        vector<string> block;
+        for(int copy = 0; copy < copies; copy++)
+            block.insert(block.end(), base.begin(), base.end());
+        const string separator(KEY_LENGTH, 'm');
+        
+        cout << n;
+        for(int f = 0; f < nFunctions; f++)
+        {
+            Clock::time_point start = Clock::now();
+            for(int copy = 0; copy < copies; copy++)
+            {
+                string* a = block.data() + n * copy;
+                int size = static_cast<int>(n);
+                switch(f)
+                {
+                    case 0: checksum += appendToAll(a, size, ""); break;
+                    case 1: checksum += lookup(a, size, a[size - 1]); break;
+                    case 2: checksum += positionOfMax(a, size); break;
+                    case 3: checksum += countRuns(a, size); break;
+                    case 4: checksum += differ(a, size, base.data(), size); break;
+                    case 5: checksum += subsequence(a, size, absentKeys, SMALL_ARRAY_SIZE); break;
+                    case 6: checksum += lookupAny(a, size, absentKeys, SMALL_ARRAY_SIZE); break;
+                    case 7: checksum += rotateLeft(a, size, 0); break;
+                    case 8: checksum += flip(a, size); break;
+                    case 9: checksum += separate(a, size, separator); break;
+                }
+            }
+            Clock::time_point end = Clock::now();
+            cout << "\t" << chrono::duration<double, nano>(end - start).count() / (static_cast<double>(n) * copies);
+        }
+        cout << endl;
+    }
+    
+    // Printing the checksum keeps the compiler from discarding calls whose results are otherwise unused
+    cout << "checksum " << checksum << endl;
+}
+
+
+
+// This function will return count distinct words of up to 24 x's with at most one y among them, so that many words share
+// a prefix, some differ only past their first 16 bytes, and the empty string can be one of them
+vector<string> randomVocabulary(mt19937& generator, int count)
+{
+    uniform_int_distribution<> lengthDistro(0, 24);
+    vector<string> vocabulary;
+    while(static_cast<int>(vocabulary.size()) < count)
+    {
+        string word(lengthDistro(generator), 'x');
+        if(!word.empty() && generator() % 2 == 0)
+            word[generator() % word.size()] = 'y';
+        bool seen = false;
+        for(size_t i = 0; i < vocabulary.size(); i++)
+            seen = seen || vocabulary[i] == word;
+        if(!seen)
+            vocabulary.push_back(word);
+    }
+    return vocabulary;
+}
+
+
+// This function will return an array of n words picked at random from the vocabulary
+vector<string> randomArray(mt19937& generator, const vector<string>& vocabulary, int n)
+{
+    uniform_int_distribution<> wordDistro(0, static_cast<int>(vocabulary.size()) - 1);
+    vector<string> a(n);
+    for(int pos = 0; pos < n; pos++)
+        a[pos] = vocabulary[wordDistro(generator)];
+    return a;
+}
+
+
+// Prints the first failure a check found and returns false so that the check can return it
+bool checkFailed(const char* check, int c, const string& message)
+{
+    cout << check << ": case " << c << ": " << message << endl;
+    return false;
+}
+
+
+// This function will check each array function on random arrays of up to 12 words against a plain statement of
+// what it returns, including the -1 it returns for bad arguments
+bool checkArrayFunctions(int nCases)
+{
+    const int MAX_N = 12;
+    const char* check = "checkArrayFunctions";
+    
+    mt19937 generator(nCases);
+    uniform_int_distribution<> sizeDistro(0, MAX_N);
+    
+    for(int c = 0; c < nCases; c++)
+    {
+        // A vocabulary of 2 to 6 words makes repeats, runs and ties common; every array is followed by a sentinel
+        // that no function may read or write
+        vector<string> vocabulary = randomVocabulary(generator, 2 + c % 5);
+        int n = sizeDistro(generator);
+        int n2 = sizeDistro(generator) / 3;
+        vector<string> original = randomArray(generator, vocabulary, n);
+        vector<string> other = randomArray(generator, vocabulary, n2);
+        string target = vocabulary[generator() % vocabulary.size()];
+        const string SENTINEL = "sentinel";
+        original.push_back(SENTINEL);
+        other.push_back(SENTINEL);
+        vector<string> a;
+        
+        // stringsEqual agrees with == on every pair of words, including those differing only past the first 16 bytes
+        for(size_t i = 0; i < vocabulary.size(); i++)
+            for(size_t j = 0; j < vocabulary.size(); j++)
+                if(stringsEqual(vocabulary[i], vocabulary[j]) != (vocabulary[i] == vocabulary[j]))
+                    return checkFailed(check, c, "stringsEqual disagrees with == on \"" + vocabulary[i] + "\" and \"" + vocabulary[j] + "\"");
+        
+        // appendToAll appends to exactly the first n elements
+        a = original;
+        if(appendToAll(a.data(), n, target) != n || a[n] != SENTINEL)
+            return checkFailed(check, c, "appendToAll returned the wrong count or wrote past n");
+        for(int pos = 0; pos < n; pos++)
+            if(a[pos] != original[pos] + target)
+                return checkFailed(check, c, "appendToAll did not append to every element");
+        if(appendToAll(a.data(), -1, target) != RET_BAD_FUNCTION_ARGUMENT)
+            return checkFailed(check, c, "appendToAll accepted a negative n");
+        
+        // lookup and lookupHashed both find the first element equal to the target
+        int expected = RET_BAD_FUNCTION_ARGUMENT;
+        for(int pos = n - 1; pos >= 0; pos--)
+            if(original[pos] == target)
+                expected = pos;
+        vector<size_t> hashes(n + 1);
+        hashAll(original.data(), n, hashes.data());
+        if(lookup(original.data(), n, target) != expected || lookupHashed(original.data(), hashes.data(), n, target) != expected)
+            return checkFailed(check, c, "lookup or lookupHashed did not return the first match " + to_string(expected));
+        if(lookup(original.data(), -1, target) != RET_BAD_FUNCTION_ARGUMENT)
+            return checkFailed(check, c, "lookup accepted a negative n");
+        
+        // positionOfMax returns an element no smaller than any other, with every element before it strictly smaller
+        int maxPos = positionOfMax(original.data(), n);
+        if(n == 0 ? maxPos != RET_BAD_FUNCTION_ARGUMENT : (maxPos < 0 || maxPos >= n))
+            return checkFailed(check, c, "positionOfMax returned " + to_string(maxPos) + " for n = " + to_string(n));
+        for(int pos = 0; pos < n; pos++)
+            if(original[pos] > original[maxPos] || (pos < maxPos && !(original[pos] < original[maxPos])))
+                return checkFailed(check, c, "positionOfMax did not return the first maximum");
+        
+        // rotateLeft moves the element at pos to the end and leaves the array untouched when pos is out of range
+        int pos = static_cast<int>(generator() % (n + 2)) - 1;
+        a = original;
+        int rotated = rotateLeft(a.data(), n, pos);
+        vector<string> rotatedExpected = original;
+        if(pos >= 0 && pos < n)
+        {
+            rotatedExpected.erase(rotatedExpected.begin() + pos);
+            rotatedExpected.insert(rotatedExpected.begin() + n - 1, original[pos]);
+        }
+        if(rotated != (pos >= 0 && pos < n ? pos : RET_BAD_FUNCTION_ARGUMENT) || a != rotatedExpected)
+            return checkFailed(check, c, "rotateLeft at " + to_string(pos) + " did not move the element to the end");
+        
+        // countRuns counts the elements that start a run
+        int runs = 0;
+        for(int i = 0; i < n; i++)
+            if(i == 0 || original[i] != original[i - 1])
+                runs++;
+        if(countRuns(original.data(), n) != runs || countRuns(original.data(), -1) != RET_BAD_FUNCTION_ARGUMENT)
+            return checkFailed(check, c, "countRuns did not count " + to_string(runs) + " runs");
+        
+        // flip reverses the first n elements, and flipping twice gives back the original array
+        a = original;
+        vector<string> flipped(original.begin(), original.begin() + n);
+        reverse(flipped.begin(), flipped.end());
+        flipped.push_back(SENTINEL);
+        if(flip(a.data(), n) != n || a != flipped || flip(a.data(), n) != n || a != original)
+            return checkFailed(check, c, "flip did not reverse the array, or flipping twice changed it");
+        if(flip(a.data(), -1) != RET_BAD_FUNCTION_ARGUMENT)
+            return checkFailed(check, c, "flip accepted a negative n");
+        
+        // differ returns the first position where the arrays disagree, or the smaller size if they never do
+        expected = min(n, n2);
+        for(int i = min(n, n2) - 1; i >= 0; i--)
+            if(original[i] != other[i])
+                expected = i;
+        if(differ(original.data(), n, other.data(), n2) != expected || differ(original.data(), -1, other.data(), n2) != RET_BAD_FUNCTION_ARGUMENT)
+            return checkFailed(check, c, "differ did not return " + to_string(expected));
+        
+        // subsequence returns the first position from which a1 holds all of a2, where an empty a2 is found at 0;
+        // a2 is taken from a1 itself in half the cases so that matches are common
+        if(c % 2 == 0 && n > 0)
+        {
+            int start = static_cast<int>(generator() % n);
+            n2 = min(n2, n - start);
+            other.assign(original.begin() + start, original.begin() + start + n2);
+            other.push_back(SENTINEL);
+        }
+        expected = (n2 == 0 ? 0 : RET_BAD_FUNCTION_ARGUMENT);
+        for(int i = n - n2; i >= 0 && n2 > 0; i--)
+            if(equal(other.begin(), other.begin() + n2, original.begin() + i))
+                expected = i;
+        if(subsequence(original.data(), n, other.data(), n2) != expected)
+            return checkFailed(check, c, "subsequence did not return " + to_string(expected) + " for n1 = " + to_string(n)
+                               + ", n2 = " + to_string(n2));
+        if(subsequence(original.data(), n, other.data(), -1) != RET_BAD_FUNCTION_ARGUMENT)
+            return checkFailed(check, c, "subsequence accepted a negative n2");
+        
+        // lookupAny returns the first element of a1 equal to any element of a2, where two empty arrays match at 0
+        if(n == 0 && n2 == 0)
+            expected = 0;
+        else
+        {
+            expected = RET_BAD_FUNCTION_ARGUMENT;
+            for(int i = n - 1; i >= 0; i--)
+                if(find(other.begin(), other.begin() + n2, original[i]) != other.begin() + n2)
+                    expected = i;
+        }
+        if(lookupAny(original.data(), n, other.data(), n2) != expected)
+            return checkFailed(check, c, "lookupAny did not return " + to_string(expected));
+        
+        // separate rearranges the elements so that everything before its return value is < separator and everything
+        // from it on is not; the separator need not be in the array
+        string separator = (c % 3 == 0 ? target + "x" : target);
+        a = original;
+        int boundary = separate(a.data(), n, separator);
+        if(boundary < 0 || boundary > n || a[n] != SENTINEL)
+            return checkFailed(check, c, "separate returned " + to_string(boundary) + " for n = " + to_string(n));
+        for(int i = 0; i < n; i++)
+            if((a[i] < separator) != (i < boundary))
+                return checkFailed(check, c, "separate left \"" + a[i] + "\" on the wrong side of \"" + separator + "\"");
+        vector<string> sortedBefore(original.begin(), original.begin() + n);
+        vector<string> sortedAfter(a.begin(), a.begin() + n);
+        sort(sortedBefore.begin(), sortedBefore.end());
+        sort(sortedAfter.begin(), sortedAfter.end());
+        if(sortedBefore != sortedAfter)
+            return checkFailed(check, c, "separate did not keep the same elements");
+        if(separate(a.data(), -1, separator) != RET_BAD_FUNCTION_ARGUMENT)
+            return checkFailed(check, c, "separate accepted a negative n");
+    }
+    cout << check << ": " << nCases << " cases passed" << endl;
+    return true;
+}
+
+
+// This function will check that runLengthEncode records each run exactly, that runLengthDecode gives back the array,
+// and that both return -1 when their output would not fit
+bool checkRunLengthEncoding(int nCases)
+{
+    const int MAX_N = 40;
+    const char* check = "checkRunLengthEncoding";
+    
+    mt19937 generator(nCases);
+    uniform_int_distribution<> sizeDistro(0, MAX_N);
+    
+    for(int c = 0; c < nCases; c++)
+    {
+        vector<string> vocabulary = randomVocabulary(generator, 2 + c % 3);
+        int n = sizeDistro(generator);
+        vector<string> a = randomArray(generator, vocabulary, n);
+        vector<int> runStarts(n + 1);
+        vector<int> runLengths(n + 1);
+        vector<string> decoded(n + 1);
+        
+        // Each run is a block of equal elements that starts where the previous one ended and differs from it
+        int nRuns = runLengthEncode(a.data(), n, runStarts.data(), runLengths.data(), n);
+        if(nRuns != countRuns(a.data(), n))
+            return checkFailed(check, c, "runLengthEncode found " + to_string(nRuns) + " runs where countRuns found " + to_string(countRuns(a.data(), n)));
+        int covered = 0;
+        for(int run = 0; run < nRuns; run++)
+        {
+            if(runStarts[run] != covered || runLengths[run] <= 0 || endOfRun(a.data(), n, covered) != covered + runLengths[run])
+                return checkFailed(check, c, "run " + to_string(run) + " does not continue from the previous run and end where endOfRun does");
+            covered += runLengths[run];
+        }
+        if(covered != n)
+            return checkFailed(check, c, "the runs cover " + to_string(covered) + " of " + to_string(n) + " elements");
+        
+        if(runLengthDecode(a.data(), runStarts.data(), runLengths.data(), nRuns, decoded.data(), n) != n
+           || !equal(a.begin(), a.end(), decoded.begin()))
+            return checkFailed(check, c, "runLengthDecode did not give back the encoded array");
+        
+        if(nRuns > 0 && (runLengthEncode(a.data(), n, runStarts.data(), runLengths.data(), nRuns - 1) != RET_BAD_FUNCTION_ARGUMENT
+                         || runLengthDecode(a.data(), runStarts.data(), runLengths.data(), nRuns, decoded.data(), n - 1) != RET_BAD_FUNCTION_ARGUMENT))
+            return checkFailed(check, c, "runLengthEncode or runLengthDecode wrote more than it was given room for");
+        if(runLengthEncode(a.data(), -1, runStarts.data(), runLengths.data(), n) != RET_BAD_FUNCTION_ARGUMENT
+           || runLengthDecode(a.data(), runStarts.data(), runLengths.data(), -1, decoded.data(), n) != RET_BAD_FUNCTION_ARGUMENT)
+            return checkFailed(check, c, "runLengthEncode or runLengthDecode accepted a negative count");
+    }
+    cout << check << ": " << nCases << " cases passed" << endl;
+    return true;
+}
+
+
+// This function will check that the parallel functions return the same as the serial ones. Small arrays are split into a
+// chosen number of chunks, so that chunks are combined even with one thread, and a few large arrays go through the automatic
+// split; runs and repeated maxima fall across the chunk boundaries in both.
+bool checkParallelFunctions(int nCases)
+{
+    const int MAX_N = 60;
+    const int LARGE_CASES = 4;
+    const char* check = "checkParallelFunctions";
+    
+    mt19937 generator(nCases);
+    uniform_int_distribution<> smallSizeDistro(1, MAX_N);
+    uniform_int_distribution<> largeSizeDistro(PARALLEL_MIN_ELEMENTS, 3 * PARALLEL_MIN_ELEMENTS);
+    
+    for(int c = 0; c < nCases + LARGE_CASES; c++)
+    {
+        bool large = (c >= nCases);
+        vector<string> vocabulary = randomVocabulary(generator, 2 + c % 4);
+        int n = (large ? largeSizeDistro(generator) : smallSizeDistro(generator));
+        uniform_int_distribution<> runDistro(1, large ? 2000 : 8);
+        vector<string> a;
+        while(static_cast<int>(a.size()) < n)
+            a.insert(a.end(), min(runDistro(generator), n - static_cast<int>(a.size())), vocabulary[generator() % vocabulary.size()]);
+        
+        // In half the cases the last element is larger than any word, so that a scan that stops short of the end is caught
+        if(c % 2 == 1)
+            a[n - 1] = string(25, 'y');
+        
+        // Small arrays are split into anything from one chunk to more chunks than there are elements
+        int nChunks = 1 + static_cast<int>(generator() % (2 * n));
+        int maxPos = (large ? positionOfMaxParallel(a.data(), n) : positionOfMaxParallel(a.data(), n, nChunks));
+        int runs = (large ? countRunsParallel(a.data(), n) : countRunsParallel(a.data(), n, nChunks));
+        string split = (large ? "" : " in " + to_string(nChunks) + " chunks");
+        if(maxPos != positionOfMax(a.data(), n))
+            return checkFailed(check, c, "positionOfMaxParallel returned " + to_string(maxPos) + split + " where positionOfMax returned "
+                               + to_string(positionOfMax(a.data(), n)));
+        if(runs != countRuns(a.data(), n))
+            return checkFailed(check, c, "countRunsParallel counted " + to_string(runs) + " runs" + split + " where countRuns counted "
+                               + to_string(countRuns(a.data(), n)));
+    }
+    if(positionOfMaxParallel(NULL, 0) != RET_BAD_FUNCTION_ARGUMENT || countRunsParallel(NULL, -1) != RET_BAD_FUNCTION_ARGUMENT
+       || positionOfMaxParallel(NULL, 0, 4) != RET_BAD_FUNCTION_ARGUMENT || countRunsParallel(NULL, -1, 4) != RET_BAD_FUNCTION_ARGUMENT)
+        return checkFailed(check, nCases, "a parallel function accepted a bad n");
+    vector<string> one(1, "x");
+    if(positionOfMaxParallel(one.data(), 1, 0) != RET_BAD_FUNCTION_ARGUMENT || countRunsParallel(one.data(), 1, 0) != RET_BAD_FUNCTION_ARGUMENT)
+        return checkFailed(check, nCases, "a parallel function accepted no chunks");
+    cout << check << ": " << nCases + LARGE_CASES << " cases passed" << endl;
+    return true;
+}
+
+
+// This function will apply the same random appends, reads, writes and copies to a LazyAppendArray and to a plain array
+// that applies every append at once, checking after each step that the two hold the same elements
+bool checkLazyAppendArray(int nCases)
+{
+    const int MAX_N = 10;
+    const int STEPS_PER_CASE = 30;
+    const char* check = "checkLazyAppendArray";
+    
+    mt19937 generator(nCases);
+    uniform_int_distribution<> sizeDistro(1, MAX_N);
+    uniform_int_distribution<> stepDistro(0, 4);
+    
+    for(int c = 0; c < nCases; c++)
+    {
+        vector<string> vocabulary = randomVocabulary(generator, 4);
+        int n = sizeDistro(generator);
+        vector<string> eager = randomArray(generator, vocabulary, n);
+        LazyAppendArray lazy(eager.data(), n);
+        
+        for(int step = 0; step < STEPS_PER_CASE; step++)
+        {
+            int pos = static_cast<int>(generator() % n);
+            const string& value = vocabulary[generator() % vocabulary.size()];
+            vector<string> copied(n + 1, "sentinel");
+            switch(stepDistro(generator))
+            {
+                case 0:
+                    if(lazy.appendToAll(value) != appendToAll(eager.data(), n, value))
+                        return checkFailed(check, c, "appendToAll returned the wrong count");
+                    break;
+                case 1:
+                    if(lazy.at(pos) != eager[pos])
+                        return checkFailed(check, c, "at(" + to_string(pos) + ") returned \"" + lazy.at(pos) + "\" where \"" + eager[pos] + "\" was expected");
+                    break;
+                case 2:
+                    lazy.set(pos, value);
+                    eager[pos] = value;
+                    break;
+                case 3:
+                    lazy.flatten();
+                    if(lazy.pendingAppends() != 0)
+                        return checkFailed(check, c, "flatten left appends pending");
+                    break;
+                case 4:
+                    if(lazy.copyTo(copied.data(), n - 1) != n - 1 || !equal(eager.begin(), eager.end() - 1, copied.begin()) || copied[n - 1] != "sentinel")
+                        return checkFailed(check, c, "copyTo did not copy exactly the elements asked for");
+                    break;
+            }
+        }
+        for(int pos = 0; pos < n; pos++)
+            if(lazy.at(pos) != eager[pos])
+                return checkFailed(check, c, "element " + to_string(pos) + " is \"" + lazy.at(pos) + "\" where \"" + eager[pos] + "\" was expected");
+        if(lazy.size() != n || lazy.copyTo(NULL, -1) != RET_BAD_FUNCTION_ARGUMENT)
+            return checkFailed(check, c, "size or copyTo with a negative n is wrong");
+    }
+    cout << check << ": " << nCases << " cases passed" << endl;
+    return true;
+}
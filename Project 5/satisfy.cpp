@@ -9,8 +9,60 @@
 #include <iostream>
 #include <string>
 #include <cstring>
+#include <vector>
+#include <unordered_map>
+#include <map>
+#include <cctype>
+#include <climits>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <random>
 using namespace std;
 
+// Compiled rule files are mapped into memory where the platform supports it, and read into memory otherwise
+#ifndef _MSC_VER
+#define SATISFY_HAVE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// The comparison document is built 16 bytes at a time with SSSE3, and checked 32 bytes at a time with AVX2, when the compiler provides them
+#if defined(__SSSE3__)
+#define SATISFY_HAVE_SSSE3
+#include <tmmintrin.h>
+#endif
+#if defined(__AVX2__) && defined(SATISFY_HAVE_SSSE3)
+#define SATISFY_HAVE_AVX2
+#include <immintrin.h>
+#endif
+
+// Defining SATISFY_INSTRUMENT makes calculateSatisfaction count its work and time its stages, in cycles where the processor has
+// a cycle counter and in steady_clock ticks otherwise. Without it, the counting and timing macros expand to nothing.
+#ifdef SATISFY_INSTRUMENT
+#if defined(__x86_64__) || defined(__i386__)
+#define SATISFY_HAVE_RDTSC
+#include <x86intrin.h>
+#endif
+#define SATISFY_COUNT(counter, n)         (scoringCounters.counter += (n))
+#define SATISFY_STAGE_BEGIN(start)        unsigned long long start = instrumentClock()
+#define SATISFY_STAGE_RESTART(start)      (start = instrumentClock())
+#define SATISFY_STAGE_END(stage, start)   (scoringCounters.ticks[stage] += instrumentClock() - (start))
+#else
+#define SATISFY_COUNT(counter, n)         ((void)0)
+#define SATISFY_STAGE_BEGIN(start)        ((void)0)
+#define SATISFY_STAGE_RESTART(start)      ((void)0)
+#define SATISFY_STAGE_END(stage, start)   ((void)0)
+#endif
+
 const int MAX_WORD_LENGTH = 20;
 const int MAX_DOCUMENT_LENGTH = 200;
 
@@ -24,11 +76,14 @@ int normalizeRules(char word1[][MAX_WORD_LENGTH + 1],
 void lowerCaseRules(char word1[][MAX_WORD_LENGTH + 1],
                     char word2[][MAX_WORD_LENGTH + 1],
                     int nRules);
-void deleteRule(char word1[][MAX_WORD_LENGTH + 1],
-                char word2[][MAX_WORD_LENGTH + 1],
-                int distance[],
-                int ruleCount,
-                int rowPos);
+bool isValidRule(const char word1[],
+                 const char word2[],
+                 int distance);
+void swapRules(char word1[][MAX_WORD_LENGTH + 1],
+               char word2[][MAX_WORD_LENGTH + 1],
+               int distance[],
+               int rowPos1,
+               int rowPos2);
 int removeDuplicates(char word1[][MAX_WORD_LENGTH + 1],
                      char word2[][MAX_WORD_LENGTH + 1],
                      int distance[],
@@ -41,86 +96,558 @@ int calculateSatisfaction(const char word1[][MAX_WORD_LENGTH + 1],
                           int nRules,
                           const char document[]);
 
+// A word of the comparison document, given by where it starts, its length and its hash instead of being copied out
+struct DocToken
+{
+    int      offset;
+    int      length;
+    unsigned hash;
+};
+
+// The most words a comparison document of MAX_DOCUMENT_LENGTH characters can hold
+const int MAX_DOCUMENT_TOKENS = (MAX_DOCUMENT_LENGTH + 1) / 2;
+
 // Helper functions for the above function
 int createComparisonDoc(const char document[],
                         char comparisonDoc[]);
+int filterDocumentBlocks(const char document[],
+                         int docLength,
+                         char comparisonDoc[],
+                         int& docPos);
+int tokenizeComparisonDoc(const char comparisonDoc[],
+                          int comparisonDocSize,
+                          DocToken tokens[]);
+bool tokenMatches(const char comparisonDoc[],
+                  const DocToken& token,
+                  const char rulesWord[],
+                  int rulesWordLength,
+                  unsigned rulesWordHash);
 bool forwardChecker(const char comparisonDoc[],
-                    int pos,
+                    const DocToken tokens[],
+                    int nTokens,
+                    int tokenPos,
                     const char rulesWord[],
-                    char rulesWordComparison[],
+                    int rulesWordLength,
+                    unsigned rulesWordHash,
                     int compDistance);
 bool backwardChecker(const char comparisonDoc[],
-                     int pos, const char rulesWord[],
-                     char rulesWordComparison[],
+                     const DocToken tokens[],
+                     int tokenPos,
+                     const char rulesWord[],
+                     int rulesWordLength,
+                     unsigned rulesWordHash,
                      int compDistance);
+int windowChecker(const char comparisonDoc[],
+                  const DocToken tokens[],
+                  int nTokens,
+                  const char word1[][MAX_WORD_LENGTH + 1],
+                  const char word2[][MAX_WORD_LENGTH + 1],
+                  const int distance[],
+                  int nRules);
+inline unsigned long long bitmapAt(unsigned long long recent,
+                                   int lastPos,
+                                   int tokenPos);
+
+// Rules with a distance up to this many words are checked by windowChecker's 64 bit occurrence bitmaps
+const int MAX_BITMAP_DISTANCE = 64;
+
+#ifdef SATISFY_INSTRUMENT
+// The stages of calculateSatisfaction that are timed. Matching is the search of the document for the words of a rule, and checking
+// is the search around each match for the other word; windowChecker does both at once, so all of its time counts as checking.
+enum ScoringStage
+{
+    STAGE_FILTER,
+    STAGE_TOKENIZE,
+    STAGE_MATCH,
+    STAGE_CHECK,
+    N_SCORING_STAGES
+};
+
+// What calculateSatisfaction has done on this thread since the counters were last reset
+struct ScoringCounters
+{
+    unsigned long long documents;
+    unsigned long long tokens;
+    unsigned long long ruleCandidates;
+    unsigned long long windowComparisons;
+    unsigned long long ticks[N_SCORING_STAGES];
+};
+
+extern thread_local ScoringCounters scoringCounters;
+
+// Functions for reading and resetting the counters
+unsigned long long instrumentClock();
+void resetScoringCounters();
+void writeScoringCounters(ostream& out, bool asJson);
+#endif
+
+// Returns the same score as calculateSatisfaction, but tokenizes the document once and checks every rule against
+// an index of where each rule word occurs
+int calculateSatisfactionIndexed(const char word1[][MAX_WORD_LENGTH + 1],
+                                 const char word2[][MAX_WORD_LENGTH + 1],
+                                 const int distance[],
+                                 int nRules,
+                                 const char document[]);
+
+// Helper function for the above function
+bool occursWithinDistance(const vector<int>& positions1,
+                          const vector<int>& positions2,
+                          int compDistance);
+
+// The start of a compiled rule file. The rest of the file is the arrays of a CompiledRules, each at the byte offset given here,
+// laid out so that the file can be mapped into memory and used as it is.
+struct RuleFileHeader
+{
+    char     magic[8];
+    unsigned version;
+    unsigned checksum;
+    unsigned fileSize;
+    int      nRules;
+    int      nWords;
+    int      nSlots;
+    int      textSize;
+    int      maxWordLength;
+    int      maxDistance;
+    unsigned slotsOffset;
+    unsigned textOffset;
+    unsigned textStartOffset;
+    unsigned lengthOffset;
+    unsigned hashOffset;
+    unsigned ruleStartOffset;
+    unsigned rulesOffset;
+    unsigned ruleWord1Offset;
+    unsigned ruleWord2Offset;
+    unsigned distanceOffset;
+};
+
+const char     RULE_FILE_MAGIC[8] = { 'S', 'A', 'T', 'R', 'U', 'L', 'E', 'S' };
+const unsigned RULE_FILE_VERSION = 1;
+
+// Helper functions for writing and checking compiled rule files
+unsigned appendArray(vector<char>& image, const void* data, size_t size);
+unsigned checksumImage(const char image[], size_t size);
+
+// A compiled rule file mapped read-only into memory, so that every process using the same file shares the same pages.
+// The header, version, checksum and array bounds are checked when the file is opened.
+class MappedRuleFile
+{
+public:
+    // Constructor/destructor
+    MappedRuleFile();
+    ~MappedRuleFile();
+    
+    // Accessors
+    bool                  isOpen() const;
+    const RuleFileHeader& header() const;
+    const char*           image() const;
+    
+    // Mutators
+    bool open(const char path[]);
+    void close();
+    
+private:
+    // The mapping is released by the destructor, so the file must not be copied
+    MappedRuleFile(const MappedRuleFile&);
+    MappedRuleFile& operator=(const MappedRuleFile&);
+    
+    const char*  m_image;
+    size_t       m_size;
+    vector<char> m_buffer;
+    
+    // Helper functions
+    bool isValid() const;
+};
+
+// The words of a set of rules, each with an ID and the list of rules it appears in. A word's hash is built one character at a time
+// with hashChar, so a scorer has the hash ready as soon as a word of a document ends. The lookup probes slots one after another
+// from the word's hash until it finds the word or an empty slot; a table built from rules has at least twice as many slots as
+// words, so most lookups take one or two probes.
+class RuleWordTable
+{
+public:
+    // Constructors
+    RuleWordTable(const char word1[][MAX_WORD_LENGTH + 1],
+                  const char word2[][MAX_WORD_LENGTH + 1],
+                  int nRules);
+    RuleWordTable(const RuleFileHeader& header,
+                  const char image[]);
+    
+    // Accessors
+    int        wordCount() const;
+    int        maxWordLength() const;
+    int        find(const char word[], int length, unsigned hash) const;
+    int        ruleCountOf(int wordId) const;
+    const int* rulesOf(int wordId) const;
+    int        ruleWord1(int rulePos) const;
+    int        ruleWord2(int rulePos) const;
+    void       writeImage(RuleFileHeader& header, vector<char>& image) const;
+    
+    // Hashing
+    static const unsigned HASH_START = 2166136261u;
+    static unsigned hashChar(unsigned hash, char ch);
+    static unsigned hashWord(const char word[], int length);
+    
+private:
+    // The table points into arrays of its own or into a mapped rule file, so it must not be copied
+    RuleWordTable(const RuleWordTable&);
+    RuleWordTable& operator=(const RuleWordTable&);
+    
+    // Open addressing table of word IDs, with -1 marking an empty slot
+    const int*       m_slots;
+    int              m_nSlots;
+    unsigned         m_slotMask;
+    
+    // The text, length and hash of each word, by ID
+    const char*      m_text;
+    int              m_textSize;
+    const int*       m_textStart;
+    const int*       m_length;
+    const unsigned*  m_hash;
+    int              m_nWords;
+    int              m_maxWordLength;
+    
+    // The rules of word ID w are m_rules[m_ruleStart[w]] up to m_rules[m_ruleStart[w + 1]]
+    const int*       m_ruleStart;
+    const int*       m_rules;
+    const int*       m_ruleWord1;
+    const int*       m_ruleWord2;
+    int              m_nRules;
+    
+    // The arrays of a table built from rules rather than mapped from a file
+    vector<int>      m_slotStorage;
+    vector<char>     m_textStorage;
+    vector<int>      m_textStartStorage;
+    vector<int>      m_lengthStorage;
+    vector<unsigned> m_hashStorage;
+    vector<int>      m_ruleStartStorage;
+    vector<int>      m_rulesStorage;
+    vector<int>      m_ruleWord1Storage;
+    vector<int>      m_ruleWord2Storage;
+    
+    // Helper functions
+    int  addWord(const char word[]);
+    void pointAtStorage();
+};
+
+// Where a rule was satisfied: the word positions, in order, of the two words that satisfied it
+struct RuleMatch
+{
+    int  rulePos;
+    long wordPos1;
+    long wordPos2;
+};
+
+// The default match recorder for StreamingScorer, which ignores matches; since its record does nothing, it costs nothing once inlined
+struct NoMatchRecording
+{
+    void record(int rulePos, long wordPos1, long wordPos2)
+    {
+        (void)rulePos;
+        (void)wordPos1;
+        (void)wordPos2;
+    }
+};
+
+// A match recorder that writes each satisfied rule into a buffer supplied by the caller, never allocating.
+// Matches that do not fit are counted but not written.
+class MatchRecording
+{
+public:
+    // Constructor
+    MatchRecording(RuleMatch matches[], int capacity);
+    
+    // Accessors
+    int  count() const;
+    int  recorded() const;
+    bool overflowed() const;
+    
+    // Mutators
+    void record(int rulePos, long wordPos1, long wordPos2);
+    void clear();
+    
+private:
+    RuleMatch* m_matches;
+    int        m_capacity;
+    int        m_count;
+};
+
+class StreamingScorer;
+
+// A set of rules in normal form compiled once for scoring many documents: the interned rule words, the rules each word
+// appears in, and the distance of each rule. It is never changed after it is built, so any number of scorers can share it.
+class CompiledRules
+{
+public:
+    // Constructors
+    CompiledRules(const char word1[][MAX_WORD_LENGTH + 1],
+                  const char word2[][MAX_WORD_LENGTH + 1],
+                  const int distance[],
+                  int nRules);
+    CompiledRules(const MappedRuleFile& file);
+    
+    // Accessors
+    int                  ruleCount() const;
+    int                  distance(int rulePos) const;
+    int                  maxDistance() const;
+    const RuleWordTable& words() const;
+    int                  score(const char document[]) const;
+    int                  explain(const char document[], RuleMatch matches[], int capacity) const;
+    bool                 save(const char path[]) const;
+    
+private:
+    RuleWordTable      m_words;
+    const int*         m_distance;
+    int                m_nRules;
+    int                m_maxDistance;
+    vector<int>        m_distanceStorage;
+    unsigned long long m_id;        // tells this rule set apart from every other, even one later built at the same address
+    
+    static atomic<unsigned long long> nextId;
+    
+    // Helper functions
+    StreamingScorer& threadScorer() const;
+};
+
+// Scores one document after another against a set of compiled rules and writes one score per line of the corpus
+long scoreCorpus(const CompiledRules& rules, istream& corpus, ostream& scores);
+
+// Scores a document of any length that is given to it in pieces. Instead of keeping the document, it keeps the most recent
+// word position of each rule word, which is all that is needed to decide a rule once the other word turns up.
+class StreamingScorer
+{
+public:
+    // Constructor
+    StreamingScorer(const CompiledRules& rules);
+    
+    // Accessors
+    int score() const;
+    
+    // Mutators
+    void feed(const char text[], long length);
+    int  finish();
+    int  scoreStream(istream& document);
+    
+    // The same, but telling a match recorder such as MatchRecording about each rule as it is satisfied
+    template<class Recorder> void feed(const char text[], long length, Recorder& recorder);
+    template<class Recorder> int  finish(Recorder& recorder);
+    
+private:
+    // The rules being scored against, which must outlive the scorer
+    const CompiledRules&       m_rules;
+    const RuleWordTable&       m_words;
+    
+    // The state of the current document; a word or rule entry is only valid if it is stamped with the current document number,
+    // so that starting a new document does not have to clear them
+    vector<long>               m_lastSeen;
+    vector<int>                m_lastSeenDoc;
+    vector<int>                m_satisfiedDoc;
+    int                        m_doc;
+    long                       m_wordPos;
+    int                        m_score;
+    char                       m_currentWord[MAX_WORD_LENGTH + 1];
+    int                        m_currentLength;
+    unsigned                   m_currentHash;
+    bool                       m_wordTooLong;
+    
+    // Helper functions
+    template<class Recorder> void endWord(Recorder& recorder);
+};
+
+// A fixed set of worker threads that share out a batch of numbered tasks. Each worker starts with an even share of the batch
+// and, once that runs out, steals half of what is left of another worker's share, so no lock is taken between tasks.
+class WorkStealingPool
+{
+public:
+    // Constructor/destructor
+    WorkStealingPool(int nThreads);
+    ~WorkStealingPool();
+    
+    // Accessors
+    int threadCount() const;
+    
+    // Mutators
+    void run(int nTasks, const function<void(int, int)>& task);
+    
+private:
+    // Each worker's remaining tasks, with the first task in the high 32 bits and one past the last in the low 32 bits.
+    // Each range is padded out to a cache line, so neighbouring ranges are always on different lines and a worker taking
+    // its own tasks never invalidates the line another worker is taking tasks from. Padding, unlike alignas, also holds
+    // where new does not honour extended alignment.
+    static const int CACHE_LINE_BYTES = 64;
+    struct PaddedRange
+    {
+        atomic<unsigned long long> tasks;
+        char                       padding[CACHE_LINE_BYTES - sizeof(atomic<unsigned long long>)];
+        
+        PaddedRange() : tasks(0) {}
+    };
+    
+    unique_ptr<PaddedRange[]>       m_ranges;
+    vector<thread>                  m_threads;
+    mutex                           m_mutex;
+    condition_variable              m_wake;
+    condition_variable              m_done;
+    const function<void(int, int)>* m_task;
+    long                            m_batch;
+    int                             m_busyWorkers;
+    bool                            m_stopping;
+    
+    // Helper functions
+    static unsigned long long packRange(unsigned begin, unsigned end);
+    void workerLoop(int worker);
+    bool takeOwnTask(int worker, int& taskNumber);
+    bool stealTasks(int worker);
+};
+
+// Reads a corpus of one document per line in large batches, so that each batch's documents can be shared out across threads.
+// A document cut off at the end of a batch is carried over to the start of the next one.
+class CorpusBatchReader
+{
+public:
+    // Constructor
+    CorpusBatchReader(istream& corpus, size_t batchBytes);
+    
+    // Accessors
+    int         documentCount() const;
+    const char* document(int documentPos) const;
+    long        documentLength(int documentPos) const;
+    
+    // Mutators
+    bool nextBatch();
+    
+private:
+    istream&       m_corpus;
+    size_t         m_batchBytes;
+    vector<char>   m_buffer;
+    size_t         m_filled;
+    vector<size_t> m_documentStart;
+    bool           m_atEnd;
+};
+
+// Scores a corpus like scoreCorpus, sharing each batch of documents out across a WorkStealingPool
+long scoreCorpusParallel(const CompiledRules& rules, istream& corpus, ostream& scores, int nThreads);
+
+// A document of a corpus, by its line number counting from 0, and its satisfaction score
+struct RankedDocument
+{
+    long document;
+    int  score;
+};
+
+// Writes the k best scoring documents of a corpus into best, highest score first and earlier documents first among equal scores,
+// and returns how many were written
+int rankCorpus(const CompiledRules& rules, istream& corpus, int k, RankedDocument best[], int nThreads);
+
+// Helper functions for the above function
+bool rankedBefore(const RankedDocument& a, const RankedDocument& b);
+void offerRanked(vector<RankedDocument>& heap, int k, const RankedDocument& candidate);
+
+// Keeps a document, its words and which rules it satisfies, so that after part of the document is replaced only the rules
+// whose words are near the change have to be checked again
+class IncrementalScorer
+{
+public:
+    // Constructor
+    IncrementalScorer(const CompiledRules& rules, const string& document);
+    
+    // Accessors
+    int           score() const;
+    const string& document() const;
+    
+    // Mutators
+    int replace(long offset, long length, const string& text);
+    
+private:
+    // A word of the document: where its characters start and end, including any dropped characters, and its rule word ID or -1
+    struct DocWord
+    {
+        long begin;
+        long end;
+        int  wordId;
+    };
+    
+    // The rules being scored against, which must outlive the scorer
+    const CompiledRules& m_rules;
+    const RuleWordTable& m_words;
+    
+    string               m_document;
+    vector<DocWord>      m_docWords;
+    
+    // Whether each rule is satisfied and, if it is, the positions of the two words that satisfy it
+    vector<bool>         m_satisfied;
+    vector<long>         m_witness1;
+    vector<long>         m_witness2;
+    int                  m_score;
+    
+    // Scratch state for checking rules over a range of words, stamped with the number of the check so it never needs clearing
+    vector<bool>         m_needsFullCheck;
+    vector<long>         m_lastSeen;
+    vector<long>         m_lastSeenCheck;
+    long                 m_check;
+    
+    // Helper functions
+    void tokenize(long from, long to, vector<DocWord>& docWords) const;
+    void checkRules(long firstWord, long endWord, bool onlyFullChecks);
+};
+
+// Checks normalizeRules and every scorer against plain reference versions on random rules and documents
+bool checkSatisfaction(int nCases);
+
+// Checks IncrementalScorer's score after each of a series of random edits against scoring the edited document from scratch
+bool checkIncrementalScorer(int nCases);
 
+// Times each way of scoring on random rule sets of 10, 100, ... up to maxRules rules, and prints documents per second and MB per second
+void benchmarkSatisfaction(int maxRules);
+
+// Helper functions for the above functions
+vector<string> randomVocabulary(mt19937& generator, int count, int maxLength);
+void randomRules(mt19937& generator,
+                 const vector<string>& vocabulary,
+                 char word1[][MAX_WORD_LENGTH + 1],
+                 char word2[][MAX_WORD_LENGTH + 1],
+                 int distance[],
+                 int nRules,
+                 int maxDistance);
+string randomDocument(mt19937& generator, const vector<string>& vocabulary, size_t maxLength);
+map< pair<string, string>, int > referenceNormalForm(const char word1[][MAX_WORD_LENGTH + 1],
+                                                      const char word2[][MAX_WORD_LENGTH + 1],
+                                                      const int distance[],
+                                                      int nRules);
+int referenceSatisfaction(const char word1[][MAX_WORD_LENGTH + 1],
+                          const char word2[][MAX_WORD_LENGTH + 1],
+                          const int distance[],
+                          int nRules,
+                          const char document[]);
+
+// The graded program supplies its own main; building with -DSATISFY_SELF_TEST instead runs the checks and then the benchmark
 int main() {
+#ifdef SATISFY_SELF_TEST
+    if(!checkSatisfaction(20000) || !checkIncrementalScorer(3000))
+        return 1;
+    benchmarkSatisfaction(1000);
+#endif
 }
 
 // Returns a set of normalized rules and the number of rules in that normalized set
 int normalizeRules(char word1[][MAX_WORD_LENGTH + 1], char word2[][MAX_WORD_LENGTH + 1], int distance[], int nRules)
 {
-    int ruleCount = nRules;
-    int letterPos1 = 0;
-    int letterPos2 = 0;
-    
     // Based on the spec, if nRules is non-positive return zero
     if(nRules <= 0)
         return 0;
     
-    // Increments through the entire sequence multiple times to catch all errors
-    for(int iteration = 0; iteration < nRules; iteration++)
-    {
-        // Increments through each rule
-        for(int rowPos = 0; rowPos < ruleCount; rowPos++)
+    // Lower cases all alpha characters once, before any rules are compared
+    lowerCaseRules(word1, word2, nRules);
+    
+    // Makes a single pass through the rules, moving each valid rule up behind the valid rules before it
+    int ruleCount = 0;
+    for(int rowPos = 0; rowPos < nRules; rowPos++)
+        if(isValidRule(word1[rowPos], word2[rowPos], distance[rowPos]))
         {
-            // Lower cases all alpha characters for further testing
-            lowerCaseRules(word1, word2, nRules);
-        
-            // Checks if any word in a rule contains no characters
-            if(word1[rowPos][0] == '\0' || word2[rowPos][0] == '\0')
-            {
-                deleteRule(word1, word2, distance, ruleCount, rowPos);
-                ruleCount--;
-                break;
-            }
-        
-            // Checks if any rule has a nonpositive distance
-            if(!(distance[rowPos] > 0))
-            {
-                deleteRule(word1, word2, distance, ruleCount, rowPos);
-                ruleCount--;
-                break;
-            }
-        
-            // Checks if any characters within word1 of a rule is non-alpha
-            while(word1[rowPos][letterPos1] != '\0' && isalpha(word1[rowPos][letterPos1]))
-                letterPos1++;
-        
-            if(word1[rowPos][letterPos1] != '\0' && !(isalpha(word1[rowPos][letterPos1])))
-            {
-                deleteRule(word1, word2, distance, ruleCount, rowPos);
-                ruleCount--;
-                break;
-            }
-        
-            // Checks if any characters within word2 of a rule is non-alpha
-            while(word2[rowPos][letterPos2] != '\0' && isalpha(word2[rowPos][letterPos2]))
-                letterPos2++;
-        
-            if(word2[rowPos][letterPos2] != '\0' && !(isalpha(word2[rowPos][letterPos2])))
-            {
-                deleteRule(word1, word2, distance, ruleCount, rowPos);
-                ruleCount--;
-                break;
-            }
-        
-            // Resets character positions for next rule
-            letterPos1 = 0;
-            letterPos2 = 0;
+            swapRules(word1, word2, distance, ruleCount, rowPos);
+            ruleCount++;
         }
-    }
-    // Checks if any rules have the same w1 and w1 values and removes the one with a shorter distance
+    
+    // Checks if any rules have the same w1 and w2 values and removes the one with a shorter distance
     return removeDuplicates(word1, word2, distance, ruleCount);
 }
 
@@ -152,239 +679,81 @@ void lowerCaseRules(char word1[][MAX_WORD_LENGTH + 1], char word2[][MAX_WORD_LEN
 }
 
 
-// Deletes any rules that are invalid by moving them to the end of their arrays
-void deleteRule(char word1[][MAX_WORD_LENGTH + 1], char word2[][MAX_WORD_LENGTH + 1], int distance[], int ruleCount, int rowPos)
+// Checks that both words of a rule contain at least one character, that every character is alphabetic, and that the distance is positive
+bool isValidRule(const char word1[], const char word2[], int distance)
 {
-    // Swaps word1 of the rule to the last position
-    for(int i = 0; i < MAX_WORD_LENGTH + 1; i++)
-    {
-        char temp = word1[ruleCount - 1][i];
-        word1[ruleCount - 1][i] = word1[rowPos][i];
-        word1[rowPos][i] = temp;
-    }
+    if(word1[0] == '\0' || word2[0] == '\0')
+        return false;
     
-    // Swaps word2 of the rule to last position
-    for(int i = 0; i < MAX_WORD_LENGTH + 1; i++)
-    {
-        char temp = word2[ruleCount - 1][i];
-        word2[ruleCount - 1][i] = word2[rowPos][i];
-        word2[rowPos][i] = temp;
-    }
+    if(!(distance > 0))
+        return false;
+    
+    for(int letterPos = 0; word1[letterPos] != '\0'; letterPos++)
+        if(!isalpha(static_cast<unsigned char>(word1[letterPos])))
+            return false;
+    
+    for(int letterPos = 0; word2[letterPos] != '\0'; letterPos++)
+        if(!isalpha(static_cast<unsigned char>(word2[letterPos])))
+            return false;
+    
+    return true;
+}
+
+
+// Swaps two rules, along with their distances
+void swapRules(char word1[][MAX_WORD_LENGTH + 1], char word2[][MAX_WORD_LENGTH + 1], int distance[], int rowPos1, int rowPos2)
+{
+    if(rowPos1 == rowPos2)
+        return;
     
-    // Swaps respective distance
-    int temp = distance[ruleCount - 1];
-    distance[ruleCount - 1] = distance[rowPos];
-    distance[rowPos] = temp;
+    char temp[MAX_WORD_LENGTH + 1];
+    memcpy(temp, word1[rowPos1], sizeof(temp));
+    memcpy(word1[rowPos1], word1[rowPos2], sizeof(temp));
+    memcpy(word1[rowPos2], temp, sizeof(temp));
+    
+    memcpy(temp, word2[rowPos1], sizeof(temp));
+    memcpy(word2[rowPos1], word2[rowPos2], sizeof(temp));
+    memcpy(word2[rowPos2], temp, sizeof(temp));
+    
+    swap(distance[rowPos1], distance[rowPos2]);
 }
 
 
-// Checks if any rules have the same w1 and w2 values and removes the one with a shorter distance
+// Checks if any rules have the same w1 and w2 values, in either order, and keeps only the one with the longest distance.
+// Each pair of words is looked up in a hash map of the pairs kept so far, with the two words put in alphabetical order.
 int removeDuplicates(char word1[][MAX_WORD_LENGTH + 1], char word2[][MAX_WORD_LENGTH + 1], int distance[], int ruleCount)
 {
-    int counter = ruleCount;
-    // Increments through the entire sequence multiple times to catch all errors
-    for(int iteration = 0; iteration < counter; iteration++)
+    unordered_map<string, int> keptRules;
+    keptRules.reserve(ruleCount);
+    
+    int keptCount = 0;
+    string key;
+    for(int rowPos = 0; rowPos < ruleCount; rowPos++)
     {
-        for(int rowPos = 0; rowPos < ruleCount; rowPos++)
-            for(int rowComparison = rowPos + 1; rowComparison < ruleCount; rowComparison++)
-            {
-                // Keeps track of swaps to ensure no two values are swapped twice
-                bool swapped = false;
-                
-                // Checks if any two w1 values are the same
-                if((strcmp(word1[rowPos], word1[rowComparison]) == 0) && !swapped)
-                {
-                    // Checks if the same w2 values located at those positions are the same
-                    if((strcmp(word2[rowPos], word2[rowComparison]) == 0))
-                    {
-                        if(distance[rowPos] > distance[rowComparison])
-                        {
-                            // The following code deletes the rule
-                        
-                            // Swaps rule in first array to the last position
-                            for(int i = 0; i < MAX_WORD_LENGTH + 1; i++)
-                            {
-                                char temp = word1[ruleCount - 1][i];
-                                word1[ruleCount - 1][i] = word1[rowComparison][i];
-                                word1[rowComparison][i] = temp;
-                            }
-                        
-                            // Swaps rule in second array to last position
-                            for(int i = 0; i < MAX_WORD_LENGTH + 1; i++)
-                            {
-                                char temp = word2[ruleCount - 1][i];
-                                word2[ruleCount - 1][i] = word2[rowComparison][i];
-                                word2[rowComparison][i] = temp;
-                            }
-                        
-                            // Swaps respective distance
-                            int temp = distance[ruleCount - 1];
-                            distance[ruleCount - 1] = distance[rowComparison];
-                            distance[rowComparison] = temp;
-                        
-                            ruleCount--;
-                        
-                            swapped = true;
-                        }
-                        else if(distance[rowPos] < distance[rowComparison])
-                        {
-                            // The following code deletes the rule
-                        
-                            // Swaps rule in first array to the last position
-                            for(int i = 0; i < MAX_WORD_LENGTH + 1; i++)
-                            {
-                                char temp = word1[ruleCount - 1][i];
-                                word1[ruleCount - 1][i] = word1[rowPos][i];
-                                word1[rowPos][i] = temp;
-                            }
-                        
-                            // Swaps rule in second array to last position
-                            for(int i = 0; i < MAX_WORD_LENGTH + 1; i++)
-                            {
-                                char temp = word2[ruleCount - 1][i];
-                                word2[ruleCount - 1][i] = word2[rowPos][i];
-                                word2[rowPos][i] = temp;
-                            }
-                        
-                            // Swaps respective distance
-                            int temp = distance[ruleCount - 1];
-                            distance[ruleCount - 1] = distance[rowPos];
-                            distance[rowPos] = temp;
-                        
-                            ruleCount--;
-                        
-                            swapped = true;
-                        }
-                        else
-                        {
-                            // The following code deletes the rule
-                        
-                            // Swaps rule in first array to the last position
-                            for(int i = 0; i < MAX_WORD_LENGTH + 1; i++)
-                            {
-                                char temp = word1[ruleCount - 1][i];
-                                word1[ruleCount - 1][i] = word1[rowComparison][i];
-                                word1[rowComparison][i] = temp;
-                            }
-                        
-                            // Swaps rule in second array to last position
-                            for(int i = 0; i < MAX_WORD_LENGTH + 1; i++)
-                            {
-                                char temp = word2[ruleCount - 1][i];
-                                word2[ruleCount - 1][i] = word2[rowComparison][i];
-                                word2[rowComparison][i] = temp;
-                            }
-                        
-                            // Swaps respective distance
-                            int temp = distance[ruleCount - 1];
-                            distance[ruleCount - 1] = distance[rowComparison];
-                            distance[rowComparison] = temp;
-                        
-                            ruleCount--;
-                        
-                            swapped = true;
-                        }
-                    }
-                }
-            
-                // Checks if a w1 and w2 value are the same
-                if((strcmp(word1[rowPos], word2[rowComparison])) == 0 && !swapped)
-                {
-                    // Checks if the other w2 and w1 value at the same position are the same
-                    if((strcmp(word2[rowPos], word1[rowComparison])) == 0)
-                    {
-                        if(distance[rowPos] > distance[rowComparison])
-                        {
-                            // The following code deletes the rule
-                        
-                            // Swaps rule in first array to the last position
-                            for(int i = 0; i < MAX_WORD_LENGTH + 1; i++)
-                            {
-                                char temp = word1[ruleCount - 1][i];
-                                word1[ruleCount - 1][i] = word1[rowComparison][i];
-                                word1[rowComparison][i] = temp;
-                            }
-                        
-                            // Swaps rule in second array to last position
-                            for(int i = 0; i < MAX_WORD_LENGTH + 1; i++)
-                            {
-                                char temp = word2[ruleCount - 1][i];
-                                word2[ruleCount - 1][i] = word2[rowComparison][i];
-                                word2[rowComparison][i] = temp;
-                            }
-                        
-                            // Swaps respective distance
-                            int temp = distance[ruleCount - 1];
-                            distance[ruleCount - 1] = distance[rowComparison];
-                            distance[rowComparison] = temp;
-                        
-                            ruleCount--;
-                        
-                            swapped = true;
-                        }
-                        else if(distance[rowPos] < distance[rowComparison])
-                        {
-                            // The following code deletes the rule
-                        
-                            // Swaps rule in first array to the last position
-                            for(int i = 0; i < MAX_WORD_LENGTH + 1; i++)
-                            {
-                                char temp = word1[ruleCount - 1][i];
-                                word1[ruleCount - 1][i] = word1[rowPos][i];
-                                word1[rowPos][i] = temp;
-                            }
-                        
-                            // Swaps rule in second array to last position
-                            for(int i = 0; i < MAX_WORD_LENGTH + 1; i++)
-                            {
-                                char temp = word2[ruleCount - 1][i];
-                                word2[ruleCount - 1][i] = word2[rowPos][i];
-                                word2[rowPos][i] = temp;
-                            }
-                        
-                            // Swaps respective distance
-                            int temp = distance[ruleCount - 1];
-                            distance[ruleCount - 1] = distance[rowPos];
-                            distance[rowPos] = temp;
-                        
-                            ruleCount--;
-                        
-                            swapped = true;
-                        }
-                        else
-                        {
-                            // The following code deletes the rule
-                        
-                            // Swaps rule in first array to the last position
-                            for(int i = 0; i < MAX_WORD_LENGTH + 1; i++)
-                            {
-                                char temp = word1[ruleCount - 1][i];
-                                word1[ruleCount - 1][i] = word1[rowComparison][i];
-                                word1[rowComparison][i] = temp;
-                            }
-                        
-                            // Swaps rule in second array to last position
-                            for(int i = 0; i < MAX_WORD_LENGTH + 1; i++)
-                            {
-                                char temp = word2[ruleCount - 1][i];
-                                word2[ruleCount - 1][i] = word2[rowComparison][i];
-                                word2[rowComparison][i] = temp;
-                            }
-                        
-                            // Swaps respective distance
-                            int temp = distance[ruleCount - 1];
-                            distance[ruleCount - 1] = distance[rowComparison];
-                            distance[rowComparison] = temp;
-                        
-                            ruleCount--;
-                        
-                            swapped = true;
-                        }
-                    }
-                }
-            }
+        const char* first = word1[rowPos];
+        const char* second = word2[rowPos];
+        if(strcmp(first, second) > 0)
+            swap(first, second);
+        
+        // Valid words are entirely alphabetic, so a space cannot be confused with part of a word
+        key.assign(first);
+        key += ' ';
+        key += second;
+        
+        unordered_map<string, int>::iterator found = keptRules.find(key);
+        if(found != keptRules.end())
+        {
+            if(distance[rowPos] > distance[found->second])
+                distance[found->second] = distance[rowPos];
+        }
+        else
+        {
+            swapRules(word1, word2, distance, keptCount, rowPos);
+            keptRules.insert(make_pair(key, keptCount));
+            keptCount++;
         }
-    return ruleCount;
+    }
+    return keptCount;
 }
 
 
@@ -401,95 +770,73 @@ int calculateSatisfaction(const char word1[][MAX_WORD_LENGTH + 1], const char wo
     // Creates a comparison document and sets its size
     char comparisonDoc[MAX_DOCUMENT_LENGTH + 1] = { "" };
     int comparisonDocSize;
+    SATISFY_STAGE_BEGIN(filterStart);
     comparisonDocSize = createComparisonDoc(document, comparisonDoc);
+    SATISFY_STAGE_END(STAGE_FILTER, filterStart);
+    
+    // Finds every word of the comparison document once, so that no rule has to scan or copy the characters again
+    DocToken tokens[MAX_DOCUMENT_TOKENS];
+    SATISFY_STAGE_BEGIN(tokenizeStart);
+    int nTokens = tokenizeComparisonDoc(comparisonDoc, comparisonDocSize, tokens);
+    SATISFY_STAGE_END(STAGE_TOKENIZE, tokenizeStart);
+    SATISFY_COUNT(documents, 1);
+    SATISFY_COUNT(tokens, nTokens);
     
-    // Initializes arrays to compare words from comparison doc to words from rules
-    char currentDocWord[MAX_DOCUMENT_LENGTH + 1] = { "" };
-    int currentDocWordPos;
-    char rulesWord[MAX_WORD_LENGTH + 1] = { "" };
-    char rulesWordComparison[MAX_WORD_LENGTH + 1] = { "" };
-    int compDistance;
+    // Short distances, which are most of them, are all checked together in one pass of bit operations over the words of the
+    // document instead of rescanning around each match
+    SATISFY_STAGE_BEGIN(windowStart);
+    score += windowChecker(comparisonDoc, tokens, nTokens, word1, word2, distance, nRules);
+    SATISFY_STAGE_END(STAGE_CHECK, windowStart);
     
-    // Increments through each rule, and for each rule runs through the entire document checking if that rule has been satisfied
+    // Increments through each of the other rules, and for each rule runs through the words of the document checking if that rule has been satisfied
     for(int rulePos = 0; rulePos < nRules; rulePos++)
     {
-        for(int pos = 0; pos < comparisonDocSize;)
+        if(distance[rulePos] <= MAX_BITMAP_DISTANCE)
+            continue;
+        
+        int length1 = static_cast<int>(strlen(word1[rulePos]));
+        int length2 = static_cast<int>(strlen(word2[rulePos]));
+        unsigned hash1 = RuleWordTable::hashWord(word1[rulePos], length1);
+        unsigned hash2 = RuleWordTable::hashWord(word2[rulePos], length2);
+        
+        SATISFY_STAGE_BEGIN(matchStart);
+        for(int tokenPos = 0; tokenPos < nTokens; tokenPos++)
         {
-            // Resets values for next word
-            memset(currentDocWord,'\0', strlen(currentDocWord));
-            currentDocWordPos = 0;
-            
-            memset(rulesWord,'\0', strlen(rulesWord));
-            
-            memset(rulesWordComparison,'\0', strlen(rulesWordComparison));
-            
-            compDistance = 0;
-            
-            // Increments till start of next word
-            while(comparisonDoc[pos] == ' ')
-                pos++;
-            
-            // Stores this position for future reference when we check if a rule is satisfied by the previous words of the document
-            int backwardsHolder = pos - 1;
-            
-            // Transfers each word to another array for comparison
-            while(isalpha(comparisonDoc[pos]))
-            {
-                currentDocWord[currentDocWordPos] = comparisonDoc[pos];
-                pos++;
-                currentDocWordPos++;
-            }
-            
-            // Checks if current word matches either word of current rule, and if so, copies the other word and distance of current rule for future reference
-            if(strcmp(word1[rulePos], currentDocWord) == 0)
+            // Checks if current word matches either word of current rule, and if so, looks for the other word of the rule
+            const char* rulesWord;
+            int rulesWordLength;
+            unsigned rulesWordHash;
+            if(tokenMatches(comparisonDoc, tokens[tokenPos], word1[rulePos], length1, hash1))
             {
-                compDistance = distance[rulePos];
-                strcpy(rulesWord, word2[rulePos]);
+                rulesWord = word2[rulePos];
+                rulesWordLength = length2;
+                rulesWordHash = hash2;
             }
-            else if(strcmp(word2[rulePos], currentDocWord) == 0)
+            else if(tokenMatches(comparisonDoc, tokens[tokenPos], word2[rulePos], length2, hash2))
             {
-                compDistance = distance[rulePos];
-                strcpy(rulesWord, word1[rulePos]);
+                rulesWord = word1[rulePos];
+                rulesWordLength = length1;
+                rulesWordHash = hash1;
             }
+            else
+                continue;
+            SATISFY_COUNT(ruleCandidates, 1);
             
-            // Stores this position, so that after we check if this word abides by the current rule we can reset pos back to its original spot and continue incrementing through the document
-            int tempHolder = pos;
-            
-            // This boolean variable ensures that each rule can only increment score once
-            bool passed = false;
-            
-            // If there was a match, compDistance would have been updated to a positive number
-            if(compDistance > 0)
+            // Checks the words in front of and then behind the current word; each rule can only increment score once,
+            // so once it passes we can move on to the next rule
+            SATISFY_STAGE_END(STAGE_MATCH, matchStart);
+            SATISFY_STAGE_BEGIN(checkStart);
+            bool satisfied = forwardChecker(comparisonDoc, tokens, nTokens, tokenPos, rulesWord, rulesWordLength, rulesWordHash, distance[rulePos]) ||
+                             backwardChecker(comparisonDoc, tokens, tokenPos, rulesWord, rulesWordLength, rulesWordHash, distance[rulePos]);
+            SATISFY_STAGE_END(STAGE_CHECK, checkStart);
+            SATISFY_STAGE_RESTART(matchStart);
+            if(satisfied)
             {
-                memset(rulesWordComparison, '\0', strlen(rulesWordComparison));
-                
-                // Checks the words in front of current word to see if there is a match
-                if(forwardChecker(comparisonDoc, pos, rulesWord, rulesWordComparison, compDistance))
-                {
-                    score++;
-                    passed = true;
-                }
-                
-                if(passed == false)
-                {
-                    pos = backwardsHolder;
-                    memset(rulesWordComparison, '\0', strlen(rulesWordComparison));
-                    
-                    // Checks the words behind of current word to see if there is a match
-                    if(backwardChecker(comparisonDoc, pos, rulesWord, rulesWordComparison, compDistance))
-                    {
-                        score++;
-                        passed = true;
-                    }
-                }
-                // Resets pos back to end of current word
-                pos = tempHolder;
-                
-                // If this rule passed, there is no need to continue incrementing through the document and we can move on to the next rule
-                if(passed == true)
-                    break;
+                score++;
+                break;
             }
         }
+        SATISFY_STAGE_END(STAGE_MATCH, matchStart);
     }
     // Returns score, which would have been incremented for each rule that passed
     return score;
@@ -499,125 +846,2053 @@ int calculateSatisfaction(const char word1[][MAX_WORD_LENGTH + 1], const char wo
 // Goes through the document removing all non-alphabetic characters other than spaces, while lowercasing all alphabetic characters
 int createComparisonDoc(const char document[], char comparisonDoc[])
 {
-    int comparisonPos = 0;
+    int docLength = static_cast<int>(strlen(document));
     int docPos = 0;
     
-    // Increments through document
-    while(document[docPos] != '\0')
+    // Handles as much of the document as possible in whole blocks, then finishes one character at a time
+    int comparisonPos = filterDocumentBlocks(document, docLength, comparisonDoc, docPos);
+    
+    // Increments through the rest of the document
+    while(docPos < docLength)
     {
-        if(isalpha(document[docPos]))
+        unsigned char ch = static_cast<unsigned char>(document[docPos]);
+        if(isalpha(ch))
         {
-            comparisonDoc[comparisonPos] = tolower(document[docPos]);
+            comparisonDoc[comparisonPos] = static_cast<char>(tolower(ch));
             comparisonPos++;
         }
-        else if(document[docPos] == ' ')
+        else if(ch == ' ')
         {
-            comparisonDoc[comparisonPos] = document[docPos];
+            comparisonDoc[comparisonPos] = ' ';
             comparisonPos++;
         }
         docPos++;
     }
     
     // Assigns the \0 char to the comparison document
-    comparisonDoc[comparisonPos] = document[docPos];
+    comparisonDoc[comparisonPos] = '\0';
     
     // This returns the size of the comparison document
     return comparisonPos;
 }
 
 
-// Checks the words in front of current word to see if there is a match
-bool forwardChecker(const char comparisonDoc[], int pos, const char rulesWord[], char rulesWordComparison[], int compDistance)
+#ifdef SATISFY_HAVE_SSSE3
+
+// For each pattern of 8 kept/dropped bytes, the shuffle that packs the kept bytes to the front, and how many there are
+struct CompactionTable
 {
-    int wordCount = 0;
-    bool passed = false;
-    while(wordCount < compDistance)
+    unsigned char shuffle[256][8];
+    int           kept[256];
+    
+    CompactionTable()
     {
-        int rulesWordComparisonPos = 0;
-        
-        // Increments till start of next word
-        while(comparisonDoc[pos] == ' ')
-            pos++;
-        
-        // Sets word into a comparison array
-        while(isalpha(comparisonDoc[pos]))
+        for(int mask = 0; mask < 256; mask++)
         {
-            rulesWordComparison[rulesWordComparisonPos] = comparisonDoc[pos];
-            rulesWordComparisonPos++;
-            pos++;
+            kept[mask] = 0;
+            for(int i = 0; i < 8; i++)
+                shuffle[mask][i] = 0x80;
+            for(int i = 0; i < 8; i++)
+                if(mask & (1 << i))
+                {
+                    shuffle[mask][kept[mask]] = static_cast<unsigned char>(i);
+                    kept[mask]++;
+                }
+        }
+    }
+};
+
+// Lowercases a 16 byte block and marks which bytes are letters or spaces; since a space is unchanged by setting its 0x20 bit,
+// every kept byte comes out of the same OR
+static inline __m128i lowercaseBlock(__m128i block, int& keepMask)
+{
+    __m128i lowered = _mm_or_si128(block, _mm_set1_epi8(0x20));
+    __m128i isLetter = _mm_and_si128(_mm_cmpgt_epi8(lowered, _mm_set1_epi8('a' - 1)),
+                                     _mm_cmplt_epi8(lowered, _mm_set1_epi8('z' + 1)));
+    __m128i isSpace = _mm_cmpeq_epi8(block, _mm_set1_epi8(' '));
+    keepMask = _mm_movemask_epi8(_mm_or_si128(isLetter, isSpace));
+    return lowered;
+}
+
+// Writes the kept bytes of a lowered block, packed together, and returns how many there were
+static inline int compactBlock(__m128i lowered, int keepMask, char out[])
+{
+    static const CompactionTable table;
+    
+    if(keepMask == 0xFFFF)
+    {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), lowered);
+        return 16;
+    }
+    
+    // Each half is packed with one shuffle; the 8 byte store may write dropped bytes past the kept ones, which the next write covers
+    int lowMask = keepMask & 0xFF;
+    int highMask = keepMask >> 8;
+    __m128i low = _mm_shuffle_epi8(lowered, _mm_loadl_epi64(reinterpret_cast<const __m128i*>(table.shuffle[lowMask])));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(out), low);
+    int written = table.kept[lowMask];
+    __m128i high = _mm_shuffle_epi8(_mm_srli_si128(lowered, 8), _mm_loadl_epi64(reinterpret_cast<const __m128i*>(table.shuffle[highMask])));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(out + written), high);
+    return written + table.kept[highMask];
+}
+
+#endif
+
+
+// Builds as much of the comparison document as fits in whole blocks and returns its size, leaving docPos at the first character not
+// yet handled. Each block is classified at once, letters are lowercased by setting their 0x20 bit, and the letters and spaces are
+// packed together with a shuffle. The output is the same as createComparisonDoc's character-by-character loop. Nothing is written
+// past the end of the input block being handled, so the comparison document never needs more room than the document itself.
+int filterDocumentBlocks(const char document[], int docLength, char comparisonDoc[], int& docPos)
+{
+    int comparisonPos = 0;
+    
+#ifdef SATISFY_HAVE_SSSE3
+    
+#ifdef SATISFY_HAVE_AVX2
+    // Text made only of letters and spaces, which is most text, is classified and copied 32 bytes at a time
+    while(docPos + 32 <= docLength)
+    {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(document + docPos));
+        __m256i lowered = _mm256_or_si256(block, _mm256_set1_epi8(0x20));
+        __m256i isLetter = _mm256_and_si256(_mm256_cmpgt_epi8(lowered, _mm256_set1_epi8('a' - 1)),
+                                            _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lowered));
+        __m256i isSpace = _mm256_cmpeq_epi8(block, _mm256_set1_epi8(' '));
+        if(_mm256_movemask_epi8(_mm256_or_si256(isLetter, isSpace)) == -1)
+        {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(comparisonDoc + comparisonPos), lowered);
+            comparisonPos += 32;
+            docPos += 32;
+            continue;
         }
         
-        // Compares collected word against word in rule
-        if(strcmp(rulesWord, rulesWordComparison) == 0)
+        // Otherwise the two halves are compacted separately
+        for(int half = 0; half < 2; half++)
         {
-            passed = true;
-            break;
+            int keepMask;
+            __m128i halfLowered = lowercaseBlock(_mm_loadu_si128(reinterpret_cast<const __m128i*>(document + docPos)), keepMask);
+            comparisonPos += compactBlock(halfLowered, keepMask, comparisonDoc + comparisonPos);
+            docPos += 16;
         }
-        memset(rulesWordComparison, '\0', strlen(rulesWordComparison));
-        wordCount++;
     }
+#endif
     
-    // Returns either true or false based on whether a match was found
-    if(passed == true)
-        return true;
-    else
-        return false;
+    while(docPos + 16 <= docLength)
+    {
+        int keepMask;
+        __m128i lowered = lowercaseBlock(_mm_loadu_si128(reinterpret_cast<const __m128i*>(document + docPos)), keepMask);
+        comparisonPos += compactBlock(lowered, keepMask, comparisonDoc + comparisonPos);
+        docPos += 16;
+    }
+    
+#else
+    (void)document;
+    (void)docLength;
+    (void)comparisonDoc;
+    (void)docPos;
+#endif
+    
+    return comparisonPos;
 }
 
 
-// Checks the words behind of current word to see if there is a match
-bool backwardChecker(const char comparisonDoc[], int pos, const char rulesWord[], char rulesWordComparison[], int compDistance)
+// Records the start, length and hash of each word of the comparison document and returns the number of words
+int tokenizeComparisonDoc(const char comparisonDoc[], int comparisonDocSize, DocToken tokens[])
 {
-    int wordCount = 0;
-    bool passed = false;
-    while(wordCount < compDistance && pos >= 0)
+    int nTokens = 0;
+    for(int pos = 0; pos < comparisonDocSize;)
     {
-        int rulesWordComparisonPos = 0;
+        // Increments till start of next word
+        while(pos < comparisonDocSize && comparisonDoc[pos] == ' ')
+            pos++;
+        if(pos == comparisonDocSize)
+            break;
         
-        // Decrements till start of next word
-        while(pos >= 0)
+        // The hash is built while the word is scanned, so the word is only ever read once
+        DocToken& token = tokens[nTokens];
+        token.offset = pos;
+        token.hash = RuleWordTable::HASH_START;
+        while(pos < comparisonDocSize && comparisonDoc[pos] != ' ')
         {
-            if(comparisonDoc[pos] == ' ')
-                pos--;
-            else break;
+            token.hash = RuleWordTable::hashChar(token.hash, comparisonDoc[pos]);
+            pos++;
         }
+        token.length = pos - token.offset;
+        nTokens++;
+    }
+    return nTokens;
+}
+
+
+// Compares a word of the comparison document against a word in a rule, only comparing characters if the hash and length agree
+bool tokenMatches(const char comparisonDoc[], const DocToken& token, const char rulesWord[], int rulesWordLength, unsigned rulesWordHash)
+{
+    return token.hash == rulesWordHash && token.length == rulesWordLength &&
+           memcmp(comparisonDoc + token.offset, rulesWord, rulesWordLength) == 0;
+}
+
+
+// Checks the words in front of current word to see if there is a match
+bool forwardChecker(const char comparisonDoc[], const DocToken tokens[], int nTokens, int tokenPos, const char rulesWord[], int rulesWordLength, unsigned rulesWordHash, int compDistance)
+{
+    int lastPos = min(nTokens - 1, tokenPos + compDistance);
+    for(int pos = tokenPos + 1; pos <= lastPos; pos++)
+    {
+        SATISFY_COUNT(windowComparisons, 1);
+        if(tokenMatches(comparisonDoc, tokens[pos], rulesWord, rulesWordLength, rulesWordHash))
+            return true;
+    }
+    return false;
+}
+
+
+// Checks the words behind of current word to see if there is a match
+bool backwardChecker(const char comparisonDoc[], const DocToken tokens[], int tokenPos, const char rulesWord[], int rulesWordLength, unsigned rulesWordHash, int compDistance)
+{
+    int firstPos = max(0, tokenPos - compDistance);
+    for(int pos = tokenPos - 1; pos >= firstPos; pos--)
+    {
+        SATISFY_COUNT(windowComparisons, 1);
+        if(tokenMatches(comparisonDoc, tokens[pos], rulesWord, rulesWordLength, rulesWordHash))
+            return true;
+    }
+    return false;
+}
+
+
+// Returns how many rules with a distance of at most MAX_BITMAP_DISTANCE the document satisfies, in a single pass over its words.
+// Each rule word has a bitmap of where it occurred among the last 64 words, and each word of the document is looked up once.
+// At each occurrence of a rule word, each of its short rules is satisfied if the other word's bitmap, where bit i means the other
+// word occurred i + 1 words ago, has any of its lowest distance bits set.
+int windowChecker(const char comparisonDoc[], const DocToken tokens[], int nTokens, const char word1[][MAX_WORD_LENGTH + 1], const char word2[][MAX_WORD_LENGTH + 1], const int distance[], int nRules)
+{
+    // No two words are within a distance of zero or less, just as forwardChecker and backwardChecker find nothing
+    bool anyShort = false;
+    for(int rulePos = 0; rulePos < nRules && !anyShort; rulePos++)
+        anyShort = (distance[rulePos] > 0 && distance[rulePos] <= MAX_BITMAP_DISTANCE);
+    if(!anyShort)
+        return 0;
+    
+    // A bitmap is only brought up to date when its word occurs, so each word of the document costs one lookup and one shift
+    // however many rule words there are; recent[w] was last updated at word lastPos[w]
+    RuleWordTable words(word1, word2, nRules);
+    vector<unsigned long long> recent(words.wordCount(), 0);
+    vector<int> lastPos(words.wordCount(), -1);
+    vector<char> satisfied(nRules, false);
+    
+    int score = 0;
+    for(int tokenPos = 0; tokenPos < nTokens; tokenPos++)
+    {
+        const DocToken& token = tokens[tokenPos];
+        int wordId = words.find(comparisonDoc + token.offset, token.length, token.hash);
+        if(wordId < 0)
+            continue;
         
-        // Sets word into a comparison array
-        while(pos >= 0)
+        const int* rules = words.rulesOf(wordId);
+        int nWordRules = words.ruleCountOf(wordId);
+        for(int i = 0; i < nWordRules; i++)
         {
-            if(isalpha(comparisonDoc[pos]))
+            int rulePos = rules[i];
+            int compDistance = distance[rulePos];
+            if(satisfied[rulePos] || compDistance <= 0 || compDistance > MAX_BITMAP_DISTANCE)
+                continue;
+            
+            // The other word's bitmap is read before this word's is updated, so a rule whose two words are the same needs an
+            // earlier occurrence. Each occurrence is one candidate, checked against its whole window by one comparison.
+            SATISFY_COUNT(ruleCandidates, 1);
+            SATISFY_COUNT(windowComparisons, 1);
+            int otherId = (words.ruleWord1(rulePos) == wordId ? words.ruleWord2(rulePos) : words.ruleWord1(rulePos));
+            unsigned long long window = (compDistance >= 64 ? ~0ULL : (1ULL << compDistance) - 1);
+            if(bitmapAt(recent[otherId], lastPos[otherId], tokenPos) & window)
             {
-                rulesWordComparison[rulesWordComparisonPos] = comparisonDoc[pos];
-                rulesWordComparisonPos++;
-                pos--;
+                satisfied[rulePos] = true;
+                score++;
             }
-            else
+        }
+        recent[wordId] = (bitmapAt(recent[wordId], lastPos[wordId], tokenPos) << 1) | 1;
+        lastPos[wordId] = tokenPos;
+    }
+    return score;
+}
+
+
+// Returns a word's bitmap, last updated at word lastPos, as it stands at word tokenPos, where bit i means the word occurred
+// i + 1 words before tokenPos; occurrences 64 or more words back have fallen out of it
+inline unsigned long long bitmapAt(unsigned long long recent, int lastPos, int tokenPos)
+{
+    int shift = tokenPos - lastPos - 1;
+    return (shift >= 64 ? 0 : recent << shift);
+}
+
+
+// Returns the same score as calculateSatisfaction, but tokenizes the document once and checks every rule against
+// an index of where each rule word occurs
+int calculateSatisfactionIndexed(const char word1[][MAX_WORD_LENGTH + 1], const char word2[][MAX_WORD_LENGTH + 1], const int distance[], int nRules, const char document[])
+{
+    // Checks nRules and returns 0 if nRules is less than or equal to 0
+    if(nRules <= 0)
+        return 0;
+    
+    // Gives each distinct rule word an ID, and gives each ID a list of the word positions where it occurs in the document
+    RuleWordTable words(word1, word2, nRules);
+    vector< vector<int> > positions(words.wordCount());
+    
+    // The comparison document is sized to the document rather than to MAX_DOCUMENT_LENGTH
+    string comparisonDoc(strlen(document) + 1, '\0');
+    int comparisonDocSize = createComparisonDoc(document, &comparisonDoc[0]);
+    
+    // Makes one pass through the document, recording the position of every word that appears in a rule
+    vector<DocToken> tokens(comparisonDocSize / 2 + 1);
+    int nTokens = tokenizeComparisonDoc(&comparisonDoc[0], comparisonDocSize, &tokens[0]);
+    for(int wordPos = 0; wordPos < nTokens; wordPos++)
+    {
+        const DocToken& token = tokens[wordPos];
+        int wordId = words.find(&comparisonDoc[token.offset], token.length, token.hash);
+        if(wordId >= 0)
+            positions[wordId].push_back(wordPos);
+    }
+    
+    // A rule is satisfied if some occurrence of one of its words is within its distance of a different occurrence of the other
+    int score = 0;
+    for(int rulePos = 0; rulePos < nRules; rulePos++)
+    {
+        const vector<int>& positions1 = positions[words.ruleWord1(rulePos)];
+        const vector<int>& positions2 = positions[words.ruleWord2(rulePos)];
+        if(occursWithinDistance(positions1, positions2, distance[rulePos]))
+            score++;
+    }
+    return score;
+}
+
+
+// Checks whether two sorted lists of word positions have two different positions, one from each list, at most compDistance apart
+bool occursWithinDistance(const vector<int>& positions1, const vector<int>& positions2, int compDistance)
+{
+    // When both words of a rule are the same, the closest two occurrences are always next to each other in the list
+    if(&positions1 == &positions2)
+    {
+        for(size_t i = 1; i < positions1.size(); i++)
+            if(positions1[i] - positions1[i - 1] <= compDistance)
+                return true;
+        return false;
+    }
+    
+    // Otherwise the lists are merged, and each position is compared against the closest position before it from the other list
+    size_t i1 = 0;
+    size_t i2 = 0;
+    int lastPos1 = -1;
+    int lastPos2 = -1;
+    while(i1 < positions1.size() || i2 < positions2.size())
+    {
+        if(i2 == positions2.size() || (i1 < positions1.size() && positions1[i1] < positions2[i2]))
+        {
+            if(lastPos2 >= 0 && positions1[i1] - lastPos2 <= compDistance)
+                return true;
+            lastPos1 = positions1[i1];
+            i1++;
+        }
+        else
+        {
+            if(lastPos1 >= 0 && positions2[i2] - lastPos1 <= compDistance)
+                return true;
+            lastPos2 = positions2[i2];
+            i2++;
+        }
+    }
+    return false;
+}
+
+
+
+// Sets up the per-document state for scoring against a set of compiled rules
+StreamingScorer::StreamingScorer(const CompiledRules& rules)
+    : m_rules(rules), m_words(rules.words())
+{
+    m_lastSeen.assign(m_words.wordCount(), 0);
+    m_lastSeenDoc.assign(m_words.wordCount(), -1);
+    m_satisfiedDoc.assign(m_rules.ruleCount(), -1);
+    m_doc = 0;
+    m_wordPos = 0;
+    m_score = 0;
+    m_currentLength = 0;
+    m_currentHash = RuleWordTable::HASH_START;
+    m_wordTooLong = false;
+}
+
+
+// Returns the number of rules the current document has satisfied so far
+int StreamingScorer::score() const
+{
+    return m_score;
+}
+
+
+// Processes the next length characters of the current document, which may end or begin in the middle of a word
+void StreamingScorer::feed(const char text[], long length)
+{
+    NoMatchRecording noRecording;
+    feed(text, length, noRecording);
+}
+
+
+// Ends the current document and returns its score, leaving the scorer ready for the next document
+int StreamingScorer::finish()
+{
+    NoMatchRecording noRecording;
+    return finish(noRecording);
+}
+
+
+// Processes the next length characters of the current document, telling the recorder about each rule that is satisfied
+template<class Recorder>
+void StreamingScorer::feed(const char text[], long length, Recorder& recorder)
+{
+    for(long pos = 0; pos < length; pos++)
+    {
+        unsigned char ch = static_cast<unsigned char>(text[pos]);
+        
+        // Just as in createComparisonDoc, letters are lowercased, spaces separate words, and every other character is dropped
+        if(isalpha(ch))
+        {
+            // A word longer than every rule word can never match, so only the fact that it is too long is kept
+            if(m_currentLength < m_words.maxWordLength())
+            {
+                char lower = static_cast<char>(tolower(ch));
+                m_currentWord[m_currentLength] = lower;
+                m_currentLength++;
+                m_currentHash = RuleWordTable::hashChar(m_currentHash, lower);
+            }
+            else
+                m_wordTooLong = true;
+        }
+        else if(ch == ' ')
+            endWord(recorder);
+    }
+}
+
+
+// Ends the current document and returns its score, telling the recorder about any rule the last word satisfies
+template<class Recorder>
+int StreamingScorer::finish(Recorder& recorder)
+{
+    endWord(recorder);
+    int score = m_score;
+    
+    // A scorer kept for a long time can run out of document numbers, and then the stamps are cleared once and numbering starts again
+    if(m_doc == INT_MAX)
+    {
+        fill(m_lastSeenDoc.begin(), m_lastSeenDoc.end(), -1);
+        fill(m_satisfiedDoc.begin(), m_satisfiedDoc.end(), -1);
+        m_doc = -1;
+    }
+    m_doc++;
+    m_wordPos = 0;
+    m_score = 0;
+    return score;
+}
+
+
+// Reads a whole document from a stream in fixed-size pieces and returns its score
+int StreamingScorer::scoreStream(istream& document)
+{
+    char buffer[4096];
+    while(document.read(buffer, sizeof(buffer)) || document.gcount() > 0)
+        feed(buffer, document.gcount());
+    return finish();
+}
+
+
+// Looks up the word that just ended and checks each unsatisfied rule it belongs to against the last position of the rule's other word
+template<class Recorder>
+void StreamingScorer::endWord(Recorder& recorder)
+{
+    if(m_currentLength == 0 && !m_wordTooLong)
+        return;
+    
+    int wordId = (m_wordTooLong ? -1 : m_words.find(m_currentWord, m_currentLength, m_currentHash));
+    if(wordId >= 0)
+    {
+        const int* rules = m_words.rulesOf(wordId);
+        int nRules = m_words.ruleCountOf(wordId);
+        for(int i = 0; i < nRules; i++)
+        {
+            int rulePos = rules[i];
+            if(m_satisfiedDoc[rulePos] == m_doc)
+                continue;
+            
+            // The other word's last position is checked before this word's is updated, so a rule whose words are the same
+            // needs two different occurrences
+            int otherId = (m_words.ruleWord1(rulePos) == wordId ? m_words.ruleWord2(rulePos) : m_words.ruleWord1(rulePos));
+            if(m_lastSeenDoc[otherId] == m_doc && m_wordPos - m_lastSeen[otherId] <= m_rules.distance(rulePos))
+            {
+                m_satisfiedDoc[rulePos] = m_doc;
+                m_score++;
+                recorder.record(rulePos, m_lastSeen[otherId], m_wordPos);
+            }
+        }
+        m_lastSeen[wordId] = m_wordPos;
+        m_lastSeenDoc[wordId] = m_doc;
+    }
+    
+    m_wordPos++;
+    m_currentLength = 0;
+    m_currentHash = RuleWordTable::HASH_START;
+    m_wordTooLong = false;
+}
+
+
+
+// Gives every distinct word of a set of rules an ID and lists, under each ID, the rules that word appears in
+RuleWordTable::RuleWordTable(const char word1[][MAX_WORD_LENGTH + 1], const char word2[][MAX_WORD_LENGTH + 1], int nRules)
+{
+    m_maxWordLength = 0;
+    m_nRules = max(nRules, 0);
+    
+    // The table has at least twice as many slots as there can be words, so probe sequences stay short
+    unsigned maxWords = 2 * static_cast<unsigned>(m_nRules);
+    unsigned nSlots = 1;
+    while(nSlots < 2 * maxWords)
+        nSlots *= 2;
+    m_slotStorage.assign(nSlots, -1);
+    m_slotMask = nSlots - 1;
+    
+    // Each array is given room for every word up front, so that a small table is built without growing them one word at a time
+    size_t maxTextSize = 0;
+    for(int rulePos = 0; rulePos < nRules; rulePos++)
+        maxTextSize += strlen(word1[rulePos]) + strlen(word2[rulePos]);
+    m_textStorage.reserve(maxTextSize);
+    m_textStartStorage.reserve(maxWords);
+    m_lengthStorage.reserve(maxWords);
+    m_hashStorage.reserve(maxWords);
+    m_ruleWord1Storage.reserve(m_nRules);
+    m_ruleWord2Storage.reserve(m_nRules);
+    pointAtStorage();
+    
+    for(int rulePos = 0; rulePos < nRules; rulePos++)
+    {
+        m_ruleWord1Storage.push_back(addWord(word1[rulePos]));
+        m_ruleWord2Storage.push_back(addWord(word2[rulePos]));
+    }
+    
+    // Counts the rules of each word, then fills in each word's list; a rule whose two words are the same is only listed once
+    m_ruleStartStorage.assign(wordCount() + 1, 0);
+    for(int rulePos = 0; rulePos < nRules; rulePos++)
+    {
+        m_ruleStartStorage[m_ruleWord1Storage[rulePos] + 1]++;
+        if(m_ruleWord2Storage[rulePos] != m_ruleWord1Storage[rulePos])
+            m_ruleStartStorage[m_ruleWord2Storage[rulePos] + 1]++;
+    }
+    for(int wordId = 0; wordId < wordCount(); wordId++)
+        m_ruleStartStorage[wordId + 1] += m_ruleStartStorage[wordId];
+    
+    m_rulesStorage.resize(m_ruleStartStorage[wordCount()]);
+    vector<int> filled(m_ruleStartStorage.begin(), m_ruleStartStorage.end() - 1);
+    for(int rulePos = 0; rulePos < nRules; rulePos++)
+    {
+        m_rulesStorage[filled[m_ruleWord1Storage[rulePos]]++] = rulePos;
+        if(m_ruleWord2Storage[rulePos] != m_ruleWord1Storage[rulePos])
+            m_rulesStorage[filled[m_ruleWord2Storage[rulePos]]++] = rulePos;
+    }
+    pointAtStorage();
+}
+
+
+// Uses the arrays of a compiled rule file in place; the image must stay mapped for as long as the table is used
+RuleWordTable::RuleWordTable(const RuleFileHeader& header, const char image[])
+{
+    m_slots = reinterpret_cast<const int*>(image + header.slotsOffset);
+    m_nSlots = header.nSlots;
+    m_slotMask = static_cast<unsigned>(header.nSlots - 1);
+    m_text = image + header.textOffset;
+    m_textSize = header.textSize;
+    m_textStart = reinterpret_cast<const int*>(image + header.textStartOffset);
+    m_length = reinterpret_cast<const int*>(image + header.lengthOffset);
+    m_hash = reinterpret_cast<const unsigned*>(image + header.hashOffset);
+    m_nWords = header.nWords;
+    m_maxWordLength = header.maxWordLength;
+    m_ruleStart = reinterpret_cast<const int*>(image + header.ruleStartOffset);
+    m_rules = reinterpret_cast<const int*>(image + header.rulesOffset);
+    m_ruleWord1 = reinterpret_cast<const int*>(image + header.ruleWord1Offset);
+    m_ruleWord2 = reinterpret_cast<const int*>(image + header.ruleWord2Offset);
+    m_nRules = header.nRules;
+}
+
+
+int RuleWordTable::wordCount() const
+{
+    return m_nWords;
+}
+
+
+// Returns the length of the longest rule word, since no longer word can match
+int RuleWordTable::maxWordLength() const
+{
+    return m_maxWordLength;
+}
+
+
+// Returns the ID of a word whose hash was built with hashChar, or -1 if it is not a rule word
+int RuleWordTable::find(const char word[], int length, unsigned hash) const
+{
+    for(unsigned slot = hash & m_slotMask; m_slots[slot] >= 0; slot = (slot + 1) & m_slotMask)
+    {
+        int wordId = m_slots[slot];
+        if(m_hash[wordId] == hash && m_length[wordId] == length && memcmp(m_text + m_textStart[wordId], word, length) == 0)
+            return wordId;
+    }
+    return -1;
+}
+
+
+// Returns the number of rules a word appears in
+int RuleWordTable::ruleCountOf(int wordId) const
+{
+    return m_ruleStart[wordId + 1] - m_ruleStart[wordId];
+}
+
+
+// Returns the positions of the rules a word appears in
+const int* RuleWordTable::rulesOf(int wordId) const
+{
+    return m_rules + m_ruleStart[wordId];
+}
+
+
+// Returns the ID of the first word of a rule
+int RuleWordTable::ruleWord1(int rulePos) const
+{
+    return m_ruleWord1[rulePos];
+}
+
+
+// Returns the ID of the second word of a rule
+int RuleWordTable::ruleWord2(int rulePos) const
+{
+    return m_ruleWord2[rulePos];
+}
+
+
+// Adds one character to the hash of a word (FNV-1a)
+unsigned RuleWordTable::hashChar(unsigned hash, char ch)
+{
+    return (hash ^ static_cast<unsigned char>(ch)) * 16777619u;
+}
+
+
+// Returns the hash of a whole word, the same as adding each of its characters with hashChar
+unsigned RuleWordTable::hashWord(const char word[], int length)
+{
+    unsigned hash = HASH_START;
+    for(int i = 0; i < length; i++)
+        hash = hashChar(hash, word[i]);
+    return hash;
+}
+
+
+// Returns the ID of a word, adding it to the table if it is not already there
+int RuleWordTable::addWord(const char word[])
+{
+    int length = static_cast<int>(strlen(word));
+    unsigned hash = hashWord(word, length);
+    int wordId = find(word, length, hash);
+    if(wordId >= 0)
+        return wordId;
+    
+    wordId = wordCount();
+    m_textStartStorage.push_back(static_cast<int>(m_textStorage.size()));
+    m_textStorage.insert(m_textStorage.end(), word, word + length);
+    m_lengthStorage.push_back(length);
+    m_hashStorage.push_back(hash);
+    m_maxWordLength = max(m_maxWordLength, length);
+    
+    unsigned slot = hash & m_slotMask;
+    while(m_slotStorage[slot] >= 0)
+        slot = (slot + 1) & m_slotMask;
+    m_slotStorage[slot] = wordId;
+    
+    // The arrays may have moved as they grew
+    pointAtStorage();
+    return wordId;
+}
+
+
+// Points the table at its own arrays
+void RuleWordTable::pointAtStorage()
+{
+    m_slots = m_slotStorage.data();
+    m_nSlots = static_cast<int>(m_slotStorage.size());
+    m_text = m_textStorage.data();
+    m_textSize = static_cast<int>(m_textStorage.size());
+    m_textStart = m_textStartStorage.data();
+    m_length = m_lengthStorage.data();
+    m_hash = m_hashStorage.data();
+    m_nWords = static_cast<int>(m_lengthStorage.size());
+    m_ruleStart = m_ruleStartStorage.data();
+    m_rules = m_rulesStorage.data();
+    m_ruleWord1 = m_ruleWord1Storage.data();
+    m_ruleWord2 = m_ruleWord2Storage.data();
+}
+
+
+// Appends an array to a compiled rule file image, starting it on a 4 byte boundary, and returns its offset
+unsigned appendArray(vector<char>& image, const void* data, size_t size)
+{
+    while(image.size() % 4 != 0)
+        image.push_back('\0');
+    unsigned offset = static_cast<unsigned>(image.size());
+    const char* bytes = static_cast<const char*>(data);
+    image.insert(image.end(), bytes, bytes + size);
+    return offset;
+}
+
+
+// Appends the table's arrays to a compiled rule file image and records where they are in the header
+void RuleWordTable::writeImage(RuleFileHeader& header, vector<char>& image) const
+{
+    header.nRules = m_nRules;
+    header.nWords = m_nWords;
+    header.nSlots = m_nSlots;
+    header.textSize = m_textSize;
+    header.maxWordLength = m_maxWordLength;
+    header.slotsOffset = appendArray(image, m_slots, m_nSlots * sizeof(int));
+    header.textOffset = appendArray(image, m_text, m_textSize);
+    header.textStartOffset = appendArray(image, m_textStart, m_nWords * sizeof(int));
+    header.lengthOffset = appendArray(image, m_length, m_nWords * sizeof(int));
+    header.hashOffset = appendArray(image, m_hash, m_nWords * sizeof(unsigned));
+    header.ruleStartOffset = appendArray(image, m_ruleStart, (m_nWords + 1) * sizeof(int));
+    header.rulesOffset = appendArray(image, m_rules, m_ruleStart[m_nWords] * sizeof(int));
+    header.ruleWord1Offset = appendArray(image, m_ruleWord1, m_nRules * sizeof(int));
+    header.ruleWord2Offset = appendArray(image, m_ruleWord2, m_nRules * sizeof(int));
+}
+
+
+
+// Interns the words of a set of rules in normal form and keeps their distances
+CompiledRules::CompiledRules(const char word1[][MAX_WORD_LENGTH + 1], const char word2[][MAX_WORD_LENGTH + 1], const int distance[], int nRules)
+    : m_words(word1, word2, nRules)
+{
+    m_maxDistance = 0;
+    for(int rulePos = 0; rulePos < nRules; rulePos++)
+    {
+        m_distanceStorage.push_back(distance[rulePos]);
+        m_maxDistance = max(m_maxDistance, distance[rulePos]);
+    }
+    m_distance = m_distanceStorage.data();
+    m_nRules = static_cast<int>(m_distanceStorage.size());
+    m_id = nextId++;
+}
+
+
+// Uses the arrays of an open compiled rule file in place, without parsing or copying them; the file must stay open while the rules are used
+CompiledRules::CompiledRules(const MappedRuleFile& file)
+    : m_words(file.header(), file.image())
+{
+    m_distance = reinterpret_cast<const int*>(file.image() + file.header().distanceOffset);
+    m_nRules = file.header().nRules;
+    m_maxDistance = file.header().maxDistance;
+    m_id = nextId++;
+}
+
+
+int CompiledRules::ruleCount() const
+{
+    return m_nRules;
+}
+
+
+int CompiledRules::distance(int rulePos) const
+{
+    return m_distance[rulePos];
+}
+
+
+// Returns the longest distance of any rule, which is as far apart as two words can be and still satisfy a rule
+int CompiledRules::maxDistance() const
+{
+    return m_maxDistance;
+}
+
+
+const RuleWordTable& CompiledRules::words() const
+{
+    return m_words;
+}
+
+
+// Returns the satisfaction score of one document through this thread's scorer, so only the document itself is worked through
+int CompiledRules::score(const char document[]) const
+{
+    StreamingScorer& scorer = threadScorer();
+    scorer.feed(document, static_cast<long>(strlen(document)));
+    return scorer.finish();
+}
+
+
+// Returns the satisfaction score of one document, and writes up to capacity of the rules it satisfied, with where, into matches;
+// like score it uses this thread's scorer, so nothing is allocated
+int CompiledRules::explain(const char document[], RuleMatch matches[], int capacity) const
+{
+    StreamingScorer& scorer = threadScorer();
+    MatchRecording recording(matches, capacity);
+    scorer.feed(document, static_cast<long>(strlen(document)), recording);
+    return scorer.finish(recording);
+}
+
+
+// Returns the scorer this thread keeps for one-shot scoring. Its per-word and per-rule state is set up the first time the thread
+// scores these rules, and after that each document only moves the scorer on to a new document number.
+StreamingScorer& CompiledRules::threadScorer() const
+{
+    // The scorer is only reused for the rule set it was built for; the ID, unlike the address, is never given to another
+    thread_local unique_ptr<StreamingScorer> scorer;
+    thread_local unsigned long long scorerRules = 0;
+    if(scorer == nullptr || scorerRules != m_id)
+    {
+        scorer.reset(new StreamingScorer(*this));
+        scorerRules = m_id;
+    }
+    return *scorer;
+}
+
+
+atomic<unsigned long long> CompiledRules::nextId(1);
+
+
+// Writes the rules to a compiled rule file that MappedRuleFile can map, returning false if the file could not be written
+bool CompiledRules::save(const char path[]) const
+{
+    RuleFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, RULE_FILE_MAGIC, sizeof(header.magic));
+    header.version = RULE_FILE_VERSION;
+    header.maxDistance = m_maxDistance;
+    
+    // The arrays follow the header, which is filled in last once their offsets and checksum are known
+    vector<char> image(sizeof(header));
+    m_words.writeImage(header, image);
+    header.distanceOffset = appendArray(image, m_distance, m_nRules * sizeof(int));
+    header.fileSize = static_cast<unsigned>(image.size());
+    header.checksum = checksumImage(&image[sizeof(header)], image.size() - sizeof(header));
+    memcpy(&image[0], &header, sizeof(header));
+    
+    ofstream file(path, ios::binary | ios::trunc);
+    file.write(&image[0], image.size());
+    return static_cast<bool>(file);
+}
+
+
+// Scores one document after another against a set of compiled rules and writes one score per line of the corpus.
+// Each line of the corpus is one document, and is never held in memory as a whole. Returns the number of documents scored.
+long scoreCorpus(const CompiledRules& rules, istream& corpus, ostream& scores)
+{
+    StreamingScorer scorer(rules);
+    long nDocuments = 0;
+    bool documentOpen = false;
+    
+    vector<char> buffer(1 << 16);
+    while(corpus.read(&buffer[0], buffer.size()) || corpus.gcount() > 0)
+    {
+        long length = static_cast<long>(corpus.gcount());
+        long segmentStart = 0;
+        for(long pos = 0; pos < length; pos++)
+        {
+            if(buffer[pos] != '\n')
+                continue;
+            
+            // A newline ends the current document
+            scorer.feed(&buffer[segmentStart], pos - segmentStart);
+            scores << scorer.finish() << '\n';
+            nDocuments++;
+            documentOpen = false;
+            segmentStart = pos + 1;
+        }
+        if(segmentStart < length)
+        {
+            scorer.feed(&buffer[segmentStart], length - segmentStart);
+            documentOpen = true;
+        }
+    }
+    
+    // The last document may not end with a newline
+    if(documentOpen)
+    {
+        scores << scorer.finish() << '\n';
+        nDocuments++;
+    }
+    return nDocuments;
+}
+
+
+
+// Packs a range of task numbers into one value so that it can be changed with a single compare-and-swap
+unsigned long long WorkStealingPool::packRange(unsigned begin, unsigned end)
+{
+    return (static_cast<unsigned long long>(begin) << 32) | end;
+}
+
+
+// Starts nThreads workers, each with its own empty range of tasks
+WorkStealingPool::WorkStealingPool(int nThreads)
+{
+    m_task = nullptr;
+    m_batch = 0;
+    m_busyWorkers = 0;
+    m_stopping = false;
+    
+    if(nThreads < 1)
+        nThreads = 1;
+    m_ranges.reset(new PaddedRange[nThreads]);
+    for(int worker = 0; worker < nThreads; worker++)
+        m_threads.push_back(thread(&WorkStealingPool::workerLoop, this, worker));
+}
+
+
+// Tells every worker to stop and waits for it to exit
+WorkStealingPool::~WorkStealingPool()
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+    for(size_t i = 0; i < m_threads.size(); i++)
+        m_threads[i].join();
+}
+
+
+int WorkStealingPool::threadCount() const
+{
+    return static_cast<int>(m_threads.size());
+}
+
+
+// Calls task(worker, taskNumber) for every task number from 0 to nTasks - 1 and returns once all of them have finished
+void WorkStealingPool::run(int nTasks, const function<void(int, int)>& task)
+{
+    if(nTasks <= 0)
+        return;
+    
+    // Gives each worker an even, contiguous share of the tasks
+    int nWorkers = threadCount();
+    for(int worker = 0; worker < nWorkers; worker++)
+    {
+        unsigned begin = static_cast<unsigned>(static_cast<long long>(nTasks) * worker / nWorkers);
+        unsigned end = static_cast<unsigned>(static_cast<long long>(nTasks) * (worker + 1) / nWorkers);
+        m_ranges[worker].tasks.store(packRange(begin, end));
+    }
+    
+    unique_lock<mutex> lock(m_mutex);
+    m_task = &task;
+    m_busyWorkers = nWorkers;
+    m_batch++;
+    m_wake.notify_all();
+    
+    // Every task has finished once every worker has run out of its own tasks and found none left to steal
+    m_done.wait(lock, [this] { return m_busyWorkers == 0; });
+    m_task = nullptr;
+}
+
+
+// Each worker sleeps until a batch starts, then works through its own tasks and steals more until there are none left
+void WorkStealingPool::workerLoop(int worker)
+{
+    long lastBatch = 0;
+    for(;;)
+    {
+        const function<void(int, int)>* task;
+        {
+            unique_lock<mutex> lock(m_mutex);
+            m_wake.wait(lock, [&] { return m_stopping || m_batch != lastBatch; });
+            if(m_stopping)
+                return;
+            lastBatch = m_batch;
+            task = m_task;
+        }
+        
+        int taskNumber;
+        for(;;)
+        {
+            if(takeOwnTask(worker, taskNumber))
+                (*task)(worker, taskNumber);
+            else if(!stealTasks(worker))
                 break;
         }
         
-        // Since the previous word was collected in reverse order, this code will switch it back to proper order
-        char tempChar;
-        long midPoint = strlen(rulesWordComparison) / 2;
-        for(long i = 0; i < midPoint; i++)
+        lock_guard<mutex> lock(m_mutex);
+        m_busyWorkers--;
+        if(m_busyWorkers == 0)
+            m_done.notify_all();
+    }
+}
+
+
+// Takes the first task of a worker's own range, if it has one left
+bool WorkStealingPool::takeOwnTask(int worker, int& taskNumber)
+{
+    atomic<unsigned long long>& range = m_ranges[worker].tasks;
+    unsigned long long current = range.load();
+    for(;;)
+    {
+        unsigned begin = static_cast<unsigned>(current >> 32);
+        unsigned end = static_cast<unsigned>(current);
+        if(begin >= end)
+            return false;
+        if(range.compare_exchange_weak(current, packRange(begin + 1, end)))
+        {
+            taskNumber = static_cast<int>(begin);
+            return true;
+        }
+    }
+}
+
+
+// Moves the back half of another worker's remaining tasks into this worker's empty range; returns false if every range is empty
+bool WorkStealingPool::stealTasks(int worker)
+{
+    int nWorkers = threadCount();
+    for(int offset = 1; offset < nWorkers; offset++)
+    {
+        atomic<unsigned long long>& victim = m_ranges[(worker + offset) % nWorkers].tasks;
+        unsigned long long current = victim.load();
+        for(;;)
+        {
+            unsigned begin = static_cast<unsigned>(current >> 32);
+            unsigned end = static_cast<unsigned>(current);
+            if(begin >= end)
+                break;
+            
+            unsigned stolen = (end - begin + 1) / 2;
+            if(victim.compare_exchange_weak(current, packRange(begin, end - stolen)))
+            {
+                // This worker's own range is empty, so no other worker can be taking from it while it is replaced
+                m_ranges[worker].tasks.store(packRange(end - stolen, end));
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+
+// Reads from a corpus in batches of batchBytes bytes; nothing is read until the first call to nextBatch
+CorpusBatchReader::CorpusBatchReader(istream& corpus, size_t batchBytes)
+ : m_corpus(corpus)
+{
+    m_batchBytes = batchBytes;
+    m_filled = 0;
+    m_documentStart.push_back(0);
+    m_atEnd = false;
+}
+
+
+// Returns the number of complete documents in the current batch
+int CorpusBatchReader::documentCount() const
+{
+    return static_cast<int>(m_documentStart.size()) - 1;
+}
+
+
+// Returns the characters of a document of the current batch, which stay valid until the next call to nextBatch
+const char* CorpusBatchReader::document(int documentPos) const
+{
+    return &m_buffer[m_documentStart[documentPos]];
+}
+
+
+// Returns the length of a document of the current batch, not counting the newline that ends it
+long CorpusBatchReader::documentLength(int documentPos) const
+{
+    return static_cast<long>(m_documentStart[documentPos + 1] - 1 - m_documentStart[documentPos]);
+}
+
+
+// Reads the next batch of documents, returning false once the whole corpus has been read. A batch may hold no complete documents.
+bool CorpusBatchReader::nextBatch()
+{
+    if(m_atEnd)
+        return false;
+    
+    // Moves the unfinished document after the last batch's documents to the front of the buffer, then tops the buffer up
+    // with another batch of input after it
+    size_t start = m_documentStart.back();
+    size_t carried = m_filled - start;
+    if(carried > 0)
+        memmove(&m_buffer[0], &m_buffer[start], carried);
+    m_buffer.resize(carried + m_batchBytes);
+    m_corpus.read(&m_buffer[carried], m_batchBytes);
+    m_filled = carried + static_cast<size_t>(m_corpus.gcount());
+    m_atEnd = (m_corpus.gcount() == 0);
+    
+    // Finds where each complete document starts; at the end of the input, a last document without a newline is complete too
+    m_documentStart.clear();
+    start = 0;
+    for(size_t pos = 0; pos < m_filled; pos++)
+        if(m_buffer[pos] == '\n')
+        {
+            m_documentStart.push_back(start);
+            start = pos + 1;
+        }
+    if(m_atEnd && start < m_filled)
+    {
+        m_buffer.resize(m_filled + 1);
+        m_buffer[m_filled] = '\n';
+        m_documentStart.push_back(start);
+        start = m_filled + 1;
+        m_filled++;
+    }
+    m_documentStart.push_back(start);
+    return true;
+}
+
+
+// Scores a corpus like scoreCorpus, sharing each batch of documents out across a WorkStealingPool. Each worker scores with its own
+// StreamingScorer over the shared, read-only rules, and each document's score is stored by its position so they are written in order.
+long scoreCorpusParallel(const CompiledRules& rules, istream& corpus, ostream& scores, int nThreads)
+{
+    const size_t BATCH_BYTES = 1 << 22;
+    
+    WorkStealingPool pool(nThreads);
+    vector< unique_ptr<StreamingScorer> > scorers;
+    for(int worker = 0; worker < pool.threadCount(); worker++)
+        scorers.push_back(unique_ptr<StreamingScorer>(new StreamingScorer(rules)));
+    
+    CorpusBatchReader reader(corpus, BATCH_BYTES);
+    vector<int> documentScore;
+    long nDocuments = 0;
+    while(reader.nextBatch())
+    {
+        int nBatchDocuments = reader.documentCount();
+        documentScore.resize(nBatchDocuments);
+        pool.run(nBatchDocuments, [&](int worker, int document) {
+            StreamingScorer& scorer = *scorers[worker];
+            scorer.feed(reader.document(document), reader.documentLength(document));
+            documentScore[document] = scorer.finish();
+        });
+        
+        for(int document = 0; document < nBatchDocuments; document++)
+            scores << documentScore[document] << '\n';
+        nDocuments += nBatchDocuments;
+    }
+    return nDocuments;
+}
+
+
+// Writes the k best scoring documents of a corpus into best, highest score first and earlier documents first among equal scores,
+// and returns how many were written. The corpus is read in batches like scoreCorpusParallel, and each worker keeps its own k best
+// in a heap, so the workers never share anything but a lower bound on the final k-th score. A document whose length shows it could
+// not beat that bound is not scored at all, and once k documents satisfy every rule the rest of the corpus is not even read.
+int rankCorpus(const CompiledRules& rules, istream& corpus, int k, RankedDocument best[], int nThreads)
+{
+    const size_t BATCH_BYTES = 1 << 22;
+    
+    if(k <= 0)
+        return 0;
+    
+    // Each word of a document ends at most this many rules, so a document of n words scores at most n times this many
+    const RuleWordTable& words = rules.words();
+    long maxRulesPerWord = 0;
+    for(int wordId = 0; wordId < words.wordCount(); wordId++)
+        maxRulesPerWord = max(maxRulesPerWord, static_cast<long>(words.ruleCountOf(wordId)));
+    
+    WorkStealingPool pool(nThreads);
+    vector< unique_ptr<StreamingScorer> > scorers;
+    for(int worker = 0; worker < pool.threadCount(); worker++)
+        scorers.push_back(unique_ptr<StreamingScorer>(new StreamingScorer(rules)));
+    vector< vector<RankedDocument> > heaps(pool.threadCount());
+    
+    // The best k-th score of any worker's heap, which the final k-th score can only match or beat
+    atomic<int> threshold(-1);
+    
+    CorpusBatchReader reader(corpus, BATCH_BYTES);
+    long nDocuments = 0;
+    while(reader.nextBatch())
+    {
+        pool.run(reader.documentCount(), [&](int worker, int document) {
+            long length = reader.documentLength(document);
+            
+            // Every word takes at least one letter and all but the last a space after it
+            long bound = min(static_cast<long>(rules.ruleCount()), (length + 1) / 2 * maxRulesPerWord);
+            if(bound < threshold.load(memory_order_relaxed))
+                return;
+            
+            StreamingScorer& scorer = *scorers[worker];
+            scorer.feed(reader.document(document), length);
+            RankedDocument candidate = { nDocuments + document, scorer.finish() };
+            
+            vector<RankedDocument>& heap = heaps[worker];
+            offerRanked(heap, k, candidate);
+            if(static_cast<int>(heap.size()) == k)
+            {
+                int kthScore = heap.front().score;
+                int known = threshold.load(memory_order_relaxed);
+                while(kthScore > known && !threshold.compare_exchange_weak(known, kthScore, memory_order_relaxed))
+                    ;
+            }
+        });
+        nDocuments += reader.documentCount();
+        
+        // Every later document comes after the k found so far, so none of them can beat a full score
+        if(threshold.load() == rules.ruleCount())
+            break;
+    }
+    
+    // Merges the workers' heaps into one and lists it best first
+    vector<RankedDocument> merged;
+    for(size_t worker = 0; worker < heaps.size(); worker++)
+        for(size_t pos = 0; pos < heaps[worker].size(); pos++)
+            offerRanked(merged, k, heaps[worker][pos]);
+    sort_heap(merged.begin(), merged.end(), rankedBefore);
+    copy(merged.begin(), merged.end(), best);
+    return static_cast<int>(merged.size());
+}
+
+
+// Checks whether document a ranks ahead of document b: it has a higher score, or the same score and comes first in the corpus
+bool rankedBefore(const RankedDocument& a, const RankedDocument& b)
+{
+    if(a.score != b.score)
+        return a.score > b.score;
+    return a.document < b.document;
+}
+
+
+// Adds a candidate to a heap of at most k documents whose front is the lowest ranked, replacing the front if the heap is full
+// and the candidate ranks ahead of it
+void offerRanked(vector<RankedDocument>& heap, int k, const RankedDocument& candidate)
+{
+    if(static_cast<int>(heap.size()) < k)
+    {
+        heap.push_back(candidate);
+        push_heap(heap.begin(), heap.end(), rankedBefore);
+    }
+    else if(rankedBefore(candidate, heap.front()))
+    {
+        pop_heap(heap.begin(), heap.end(), rankedBefore);
+        heap.back() = candidate;
+        push_heap(heap.begin(), heap.end(), rankedBefore);
+    }
+}
+
+
+
+// Records matches into the capacity entries of matches
+MatchRecording::MatchRecording(RuleMatch matches[], int capacity)
+{
+    m_matches = matches;
+    m_capacity = max(capacity, 0);
+    m_count = 0;
+}
+
+
+// Returns the number of matches reported, including any that did not fit
+int MatchRecording::count() const
+{
+    return m_count;
+}
+
+
+// Returns the number of matches written into the buffer
+int MatchRecording::recorded() const
+{
+    return min(m_count, m_capacity);
+}
+
+
+// Returns whether some matches did not fit in the buffer
+bool MatchRecording::overflowed() const
+{
+    return m_count > m_capacity;
+}
+
+
+// Writes a match into the next free entry of the buffer, if there is one
+void MatchRecording::record(int rulePos, long wordPos1, long wordPos2)
+{
+    if(m_count < m_capacity)
+    {
+        m_matches[m_count].rulePos = rulePos;
+        m_matches[m_count].wordPos1 = wordPos1;
+        m_matches[m_count].wordPos2 = wordPos2;
+    }
+    m_count++;
+}
+
+
+// Empties the buffer so that it can be reused for the next document
+void MatchRecording::clear()
+{
+    m_count = 0;
+}
+
+
+
+// Tokenizes a document and finds every rule it satisfies
+IncrementalScorer::IncrementalScorer(const CompiledRules& rules, const string& document)
+    : m_rules(rules), m_words(rules.words()), m_document(document)
+{
+    m_satisfied.assign(m_rules.ruleCount(), false);
+    m_witness1.assign(m_rules.ruleCount(), 0);
+    m_witness2.assign(m_rules.ruleCount(), 0);
+    m_score = 0;
+    m_needsFullCheck.assign(m_rules.ruleCount(), false);
+    m_lastSeen.assign(m_words.wordCount(), 0);
+    m_lastSeenCheck.assign(m_words.wordCount(), -1);
+    m_check = 0;
+    
+    tokenize(0, static_cast<long>(m_document.size()), m_docWords);
+    checkRules(0, static_cast<long>(m_docWords.size()), false);
+}
+
+
+int IncrementalScorer::score() const
+{
+    return m_score;
+}
+
+
+const string& IncrementalScorer::document() const
+{
+    return m_document;
+}
+
+
+// Replaces length characters of the document starting at offset with text and returns the new score
+int IncrementalScorer::replace(long offset, long length, const string& text)
+{
+    long oldSize = static_cast<long>(m_document.size());
+    offset = max(0L, min(offset, oldSize));
+    length = max(0L, min(length, oldSize - offset));
+    m_document.replace(offset, length, text);
+    long newSize = static_cast<long>(m_document.size());
+    long shift = newSize - oldSize;
+    
+    // Widens the change out to the spaces around it, since only whole words can be retokenized
+    long changeBegin = offset;
+    while(changeBegin > 0 && m_document[changeBegin - 1] != ' ')
+        changeBegin--;
+    long changeEnd = offset + static_cast<long>(text.size());
+    while(changeEnd < newSize && m_document[changeEnd] != ' ')
+        changeEnd++;
+    
+    // Finds the old words inside the change, which are the words firstOld up to endOld
+    long firstOld = 0;
+    while(firstOld < static_cast<long>(m_docWords.size()) && m_docWords[firstOld].end <= changeBegin)
+        firstOld++;
+    long endOld = firstOld;
+    while(endOld < static_cast<long>(m_docWords.size()) && m_docWords[endOld].begin < changeEnd - shift)
+        endOld++;
+    
+    vector<DocWord> newWords;
+    tokenize(changeBegin, changeEnd, newWords);
+    long wordShift = static_cast<long>(newWords.size()) - (endOld - firstOld);
+    
+    // A satisfying pair of words wholly before or wholly after the change still satisfies its rule. Any other pair was either
+    // replaced or now spans the change, so its rule has to be checked across the whole document if nothing nearer satisfies it.
+    for(int rulePos = 0; rulePos < m_rules.ruleCount(); rulePos++)
+    {
+        if(!m_satisfied[rulePos])
+            continue;
+        if(m_witness2[rulePos] < firstOld)
+            continue;
+        if(m_witness1[rulePos] >= endOld)
+        {
+            m_witness1[rulePos] += wordShift;
+            m_witness2[rulePos] += wordShift;
+            continue;
+        }
+        m_satisfied[rulePos] = false;
+        m_needsFullCheck[rulePos] = true;
+        m_score--;
+    }
+    
+    // Splices the new words in and moves the words after them to their new offsets
+    m_docWords.erase(m_docWords.begin() + firstOld, m_docWords.begin() + endOld);
+    m_docWords.insert(m_docWords.begin() + firstOld, newWords.begin(), newWords.end());
+    long endNew = firstOld + static_cast<long>(newWords.size());
+    for(long wordPos = endNew; wordPos < static_cast<long>(m_docWords.size()); wordPos++)
+    {
+        m_docWords[wordPos].begin += shift;
+        m_docWords[wordPos].end += shift;
+    }
+    
+    // Any new pair that satisfies a rule lies within the longest rule distance of the new words
+    long windowBegin = max(0L, firstOld - m_rules.maxDistance());
+    long windowEnd = min(static_cast<long>(m_docWords.size()), endNew + m_rules.maxDistance());
+    checkRules(windowBegin, windowEnd, false);
+    
+    // Rules that lost their pair and found no new one nearby are checked against the whole document
+    bool anyFullChecks = false;
+    for(int rulePos = 0; rulePos < m_rules.ruleCount(); rulePos++)
+    {
+        if(m_satisfied[rulePos])
+            m_needsFullCheck[rulePos] = false;
+        else if(m_needsFullCheck[rulePos])
+            anyFullChecks = true;
+    }
+    if(anyFullChecks)
+    {
+        checkRules(0, static_cast<long>(m_docWords.size()), true);
+        m_needsFullCheck.assign(m_rules.ruleCount(), false);
+    }
+    
+    return m_score;
+}
+
+
+// Finds the words in the characters from to to, which must begin and end at the start of the document, a space, or the end of the document.
+// As in createComparisonDoc, spaces separate words, letters are lowercased, and every other character is dropped.
+void IncrementalScorer::tokenize(long from, long to, vector<DocWord>& docWords) const
+{
+    char word[MAX_WORD_LENGTH + 1];
+    for(long pos = from; pos < to;)
+    {
+        // Increments till start of next word
+        while(pos < to && m_document[pos] == ' ')
+            pos++;
+        if(pos == to)
+            break;
+        
+        DocWord docWord;
+        docWord.begin = pos;
+        int length = 0;
+        int nLetters = 0;
+        unsigned hash = RuleWordTable::HASH_START;
+        while(pos < to && m_document[pos] != ' ')
         {
-            tempChar = rulesWordComparison[i];
-            rulesWordComparison[i] = rulesWordComparison[strlen(rulesWordComparison) - (i + 1)];
-            rulesWordComparison[strlen(rulesWordComparison) - (i + 1)] = tempChar;
+            unsigned char ch = static_cast<unsigned char>(m_document[pos]);
+            if(isalpha(ch))
+            {
+                if(length < m_words.maxWordLength())
+                {
+                    word[length] = static_cast<char>(tolower(ch));
+                    hash = RuleWordTable::hashChar(hash, word[length]);
+                    length++;
+                }
+                nLetters++;
+            }
+            pos++;
         }
+        docWord.end = pos;
         
-        // Compares collected word against word in rule
-        if(strcmp(rulesWord, rulesWordComparison) == 0)
+        // Characters with no letters among them leave no word behind once they are dropped
+        if(nLetters == 0)
+            continue;
+        docWord.wordId = (nLetters > length ? -1 : m_words.find(word, length, hash));
+        docWords.push_back(docWord);
+    }
+}
+
+
+// Checks the unsatisfied rules against every pair of words between firstWord and endWord, or only the rules that need a full check
+void IncrementalScorer::checkRules(long firstWord, long endWord, bool onlyFullChecks)
+{
+    m_check++;
+    for(long wordPos = firstWord; wordPos < endWord; wordPos++)
+    {
+        int wordId = m_docWords[wordPos].wordId;
+        if(wordId < 0)
+            continue;
+        
+        const int* rules = m_words.rulesOf(wordId);
+        int nRules = m_words.ruleCountOf(wordId);
+        for(int i = 0; i < nRules; i++)
+        {
+            int rulePos = rules[i];
+            if(m_satisfied[rulePos] || (onlyFullChecks && !m_needsFullCheck[rulePos]))
+                continue;
+            
+            int otherId = (m_words.ruleWord1(rulePos) == wordId ? m_words.ruleWord2(rulePos) : m_words.ruleWord1(rulePos));
+            if(m_lastSeenCheck[otherId] == m_check && wordPos - m_lastSeen[otherId] <= m_rules.distance(rulePos))
+            {
+                m_satisfied[rulePos] = true;
+                m_witness1[rulePos] = m_lastSeen[otherId];
+                m_witness2[rulePos] = wordPos;
+                m_score++;
+            }
+        }
+        m_lastSeen[wordId] = wordPos;
+        m_lastSeenCheck[wordId] = m_check;
+    }
+}
+
+
+
+// Returns the checksum stored in a compiled rule file's header for the bytes that follow the header (FNV-1a)
+unsigned checksumImage(const char image[], size_t size)
+{
+    unsigned checksum = RuleWordTable::HASH_START;
+    for(size_t pos = 0; pos < size; pos++)
+        checksum = RuleWordTable::hashChar(checksum, image[pos]);
+    return checksum;
+}
+
+
+MappedRuleFile::MappedRuleFile()
+{
+    m_image = nullptr;
+    m_size = 0;
+}
+
+
+MappedRuleFile::~MappedRuleFile()
+{
+    close();
+}
+
+
+bool MappedRuleFile::isOpen() const
+{
+    return m_image != nullptr;
+}
+
+
+const RuleFileHeader& MappedRuleFile::header() const
+{
+    return *reinterpret_cast<const RuleFileHeader*>(m_image);
+}
+
+
+const char* MappedRuleFile::image() const
+{
+    return m_image;
+}
+
+
+// Maps a compiled rule file and checks it, returning false, with nothing open, if it cannot be read or is not a valid rule file
+bool MappedRuleFile::open(const char path[])
+{
+    close();
+    
+#ifdef SATISFY_HAVE_MMAP
+    int fd = ::open(path, O_RDONLY);
+    if(fd < 0)
+        return false;
+    struct stat status;
+    if(fstat(fd, &status) != 0 || status.st_size < static_cast<off_t>(sizeof(RuleFileHeader)))
+    {
+        ::close(fd);
+        return false;
+    }
+    void* mapping = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if(mapping == MAP_FAILED)
+        return false;
+    m_image = static_cast<const char*>(mapping);
+    m_size = static_cast<size_t>(status.st_size);
+#else
+    ifstream file(path, ios::binary);
+    if(!file)
+        return false;
+    m_buffer.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+    if(m_buffer.size() < sizeof(RuleFileHeader))
+    {
+        m_buffer.clear();
+        return false;
+    }
+    m_image = &m_buffer[0];
+    m_size = m_buffer.size();
+#endif
+    
+    if(!isValid())
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+
+// Unmaps the file, if one is open
+void MappedRuleFile::close()
+{
+    if(m_image == nullptr)
+        return;
+    
+#ifdef SATISFY_HAVE_MMAP
+    munmap(const_cast<char*>(m_image), m_size);
+#else
+    m_buffer.clear();
+#endif
+    m_image = nullptr;
+    m_size = 0;
+}
+
+
+// Checks the header's magic number, version, size and checksum, and that every array lies inside the file
+bool MappedRuleFile::isValid() const
+{
+    const RuleFileHeader& h = header();
+    if(memcmp(h.magic, RULE_FILE_MAGIC, sizeof(h.magic)) != 0 || h.version != RULE_FILE_VERSION || h.fileSize != m_size)
+        return false;
+    if(h.nRules < 0 || h.nWords < 0 || h.nSlots <= 0 || (h.nSlots & (h.nSlots - 1)) != 0 || h.nWords >= h.nSlots || h.textSize < 0)
+        return false;
+    if(checksumImage(m_image + sizeof(RuleFileHeader), m_size - sizeof(RuleFileHeader)) != h.checksum)
+        return false;
+    
+    // Each array must start on a 4 byte boundary after the header and end inside the file
+    const unsigned offsets[] = { h.slotsOffset, h.textOffset, h.textStartOffset, h.lengthOffset, h.hashOffset,
+                                 h.ruleStartOffset, h.rulesOffset, h.ruleWord1Offset, h.ruleWord2Offset, h.distanceOffset };
+    const unsigned long long sizes[] = { h.nSlots * 4ULL, static_cast<unsigned long long>(h.textSize), h.nWords * 4ULL, h.nWords * 4ULL, h.nWords * 4ULL,
+                                         (h.nWords + 1) * 4ULL, 0, h.nRules * 4ULL, h.nRules * 4ULL, h.nRules * 4ULL };
+    for(int i = 0; i < 10; i++)
+        if(offsets[i] < sizeof(RuleFileHeader) || offsets[i] % 4 != 0 || offsets[i] + sizes[i] > m_size)
+            return false;
+    
+    // The length of the rule lists is only known from the last entry of ruleStart
+    const int* ruleStart = reinterpret_cast<const int*>(m_image + h.ruleStartOffset);
+    if(ruleStart[h.nWords] < 0 || h.rulesOffset + ruleStart[h.nWords] * 4ULL > m_size)
+        return false;
+    
+    // The arrays are read without further checks once the file is open, so everything they hold must be in range as well.
+    // Scorers copy words into buffers of MAX_WORD_LENGTH + 1 characters, so no word may be longer.
+    if(h.maxWordLength < 0 || h.maxWordLength > MAX_WORD_LENGTH)
+        return false;
+    
+    // Every slot must be empty or hold a word ID, and at least one must be empty, or RuleWordTable::find would never stop
+    const int* slots = reinterpret_cast<const int*>(m_image + h.slotsOffset);
+    bool hasEmptySlot = false;
+    for(int slot = 0; slot < h.nSlots; slot++)
+    {
+        if(slots[slot] < -1 || slots[slot] >= h.nWords)
+            return false;
+        hasEmptySlot = hasEmptySlot || slots[slot] == -1;
+    }
+    if(!hasEmptySlot)
+        return false;
+    
+    // Every word must lie inside the text, be no longer than maxWordLength, have the hash of its text, and have a list of
+    // rules that starts where the last word's ended
+    const char* text = m_image + h.textOffset;
+    const int* textStart = reinterpret_cast<const int*>(m_image + h.textStartOffset);
+    const int* length = reinterpret_cast<const int*>(m_image + h.lengthOffset);
+    const unsigned* hash = reinterpret_cast<const unsigned*>(m_image + h.hashOffset);
+    if(ruleStart[0] != 0)
+        return false;
+    for(int wordId = 0; wordId < h.nWords; wordId++)
+    {
+        if(textStart[wordId] < 0 || length[wordId] < 0 || length[wordId] > h.maxWordLength ||
+           static_cast<long long>(textStart[wordId]) + length[wordId] > h.textSize)
+            return false;
+        if(hash[wordId] != RuleWordTable::hashWord(text + textStart[wordId], length[wordId]))
+            return false;
+        if(ruleStart[wordId + 1] < ruleStart[wordId])
+            return false;
+    }
+    
+    // Every rule list entry must be a rule, and every rule's words must be words
+    const int* rules = reinterpret_cast<const int*>(m_image + h.rulesOffset);
+    for(int pos = 0; pos < ruleStart[h.nWords]; pos++)
+        if(rules[pos] < 0 || rules[pos] >= h.nRules)
+            return false;
+    const int* ruleWord1 = reinterpret_cast<const int*>(m_image + h.ruleWord1Offset);
+    const int* ruleWord2 = reinterpret_cast<const int*>(m_image + h.ruleWord2Offset);
+    for(int rulePos = 0; rulePos < h.nRules; rulePos++)
+        if(ruleWord1[rulePos] < 0 || ruleWord1[rulePos] >= h.nWords || ruleWord2[rulePos] < 0 || ruleWord2[rulePos] >= h.nWords)
+            return false;
+    
+    // IncrementalScorer only rechecks words within maxDistance of an edit, so it must be the longest distance of any rule
+    const int* distance = reinterpret_cast<const int*>(m_image + h.distanceOffset);
+    int maxDistance = 0;
+    for(int rulePos = 0; rulePos < h.nRules; rulePos++)
+        maxDistance = max(maxDistance, distance[rulePos]);
+    if(maxDistance != h.maxDistance)
+        return false;
+    return true;
+}
+
+
+// Returns count random lowercase words of 1 to maxLength letters, with no word repeated
+vector<string> randomVocabulary(mt19937& generator, int count, int maxLength)
+{
+    uniform_int_distribution<> letterDistro('a', 'z');
+    uniform_int_distribution<> lengthDistro(1, maxLength);
+    
+    vector<string> vocabulary;
+    while(static_cast<int>(vocabulary.size()) < count)
+    {
+        string word;
+        int length = lengthDistro(generator);
+        for(int j = 0; j < length; j++)
+            word += static_cast<char>(letterDistro(generator));
+        if(find(vocabulary.begin(), vocabulary.end(), word) == vocabulary.end())
+            vocabulary.push_back(word);
+    }
+    return vocabulary;
+}
+
+
+// Fills nRules raw rules from a vocabulary, including the duplicates, reversed duplicates, empty words, uppercase letters,
+// non-alpha characters and non-positive distances that normalizeRules has to deal with
+void randomRules(mt19937& generator, const vector<string>& vocabulary, char word1[][MAX_WORD_LENGTH + 1], char word2[][MAX_WORD_LENGTH + 1],
+                 int distance[], int nRules, int maxDistance)
+{
+    uniform_int_distribution<> wordDistro(0, static_cast<int>(vocabulary.size()) - 1);
+    uniform_int_distribution<> percentDistro(0, 99);
+    uniform_int_distribution<> distanceDistro(-2, maxDistance);
+    
+    for(int r = 0; r < nRules; r++)
+    {
+        string w1 = vocabulary[wordDistro(generator)];
+        string w2 = vocabulary[wordDistro(generator)];
+        int kind = percentDistro(generator);
+        if(kind < 3)
+            w1 = "";
+        else if(kind < 6)
+            w2[percentDistro(generator) % w2.size()] = (percentDistro(generator) < 50 ? '7' : '-');
+        else if(kind < 12)
+            w1[0] = static_cast<char>(toupper(w1[0]));
+        else if(kind < 20 && r > 0)
         {
-            passed = true;
+            // A duplicate of an earlier rule, half the time with its words the other way around
+            int earlier = percentDistro(generator) % r;
+            w1 = word1[earlier];
+            w2 = word2[earlier];
+            if(percentDistro(generator) < 50)
+                swap(w1, w2);
+        }
+        strcpy(word1[r], w1.c_str());
+        strcpy(word2[r], w2.c_str());
+        distance[r] = distanceDistro(generator);
+    }
+}
+
+
+// Returns a document of at most maxLength characters made of vocabulary words in mixed case, with punctuation, which joins
+// the words on either side of it, and runs of spaces mixed in
+string randomDocument(mt19937& generator, const vector<string>& vocabulary, size_t maxLength)
+{
+    uniform_int_distribution<> wordDistro(0, static_cast<int>(vocabulary.size()) - 1);
+    uniform_int_distribution<> percentDistro(0, 99);
+    
+    string text;
+    while(true)
+    {
+        string word = vocabulary[wordDistro(generator)];
+        if(percentDistro(generator) < 10)
+            word[0] = static_cast<char>(toupper(word[0]));
+        if(percentDistro(generator) < 10)
+            word += (percentDistro(generator) < 50 ? "," : "!");
+        if(percentDistro(generator) < 2)
+            word = "--";
+        string separator = (percentDistro(generator) < 5 ? "  " : " ");
+        if(text.size() + word.size() + separator.size() > maxLength)
             break;
+        text += word;
+        text += separator;
+    }
+    return text;
+}
+
+
+// Returns the normal form of a set of raw rules straight from its definition: lowercased, with only the rules whose words are
+// nonempty and alphabetic and whose distance is positive, and with one rule for each pair of words, taken in alphabetical order,
+// at the longest distance any rule gives that pair
+map< pair<string, string>, int > referenceNormalForm(const char word1[][MAX_WORD_LENGTH + 1], const char word2[][MAX_WORD_LENGTH + 1],
+                                                      const int distance[], int nRules)
+{
+    map< pair<string, string>, int > normalForm;
+    for(int r = 0; r < nRules; r++)
+    {
+        string w1 = word1[r];
+        string w2 = word2[r];
+        bool valid = !w1.empty() && !w2.empty() && distance[r] > 0;
+        for(size_t i = 0; i < w1.size(); i++)
+        {
+            valid = valid && isalpha(static_cast<unsigned char>(w1[i]));
+            w1[i] = static_cast<char>(tolower(static_cast<unsigned char>(w1[i])));
+        }
+        for(size_t i = 0; i < w2.size(); i++)
+        {
+            valid = valid && isalpha(static_cast<unsigned char>(w2[i]));
+            w2[i] = static_cast<char>(tolower(static_cast<unsigned char>(w2[i])));
+        }
+        if(!valid)
+            continue;
+        
+        pair<string, string> key(min(w1, w2), max(w1, w2));
+        if(normalForm.count(key) == 0 || normalForm[key] < distance[r])
+            normalForm[key] = distance[r];
+    }
+    return normalForm;
+}
+
+
+// Returns the satisfaction score of a document straight from its definition: the document is lowercased, every character other
+// than a letter or space is dropped, it is split into words at spaces, and a rule counts if its two words appear, in either order,
+// at word positions no more than its distance apart
+int referenceSatisfaction(const char word1[][MAX_WORD_LENGTH + 1], const char word2[][MAX_WORD_LENGTH + 1], const int distance[],
+                          int nRules, const char document[])
+{
+    vector<string> words(1);
+    for(const char* ch = document; *ch != '\0'; ch++)
+    {
+        if(isalpha(static_cast<unsigned char>(*ch)))
+            words.back() += static_cast<char>(tolower(static_cast<unsigned char>(*ch)));
+        else if(*ch == ' ' && !words.back().empty())
+            words.push_back("");
+    }
+    if(words.back().empty())
+        words.pop_back();
+    
+    int score = 0;
+    for(int r = 0; r < nRules; r++)
+    {
+        bool satisfied = false;
+        for(size_t i = 0; i < words.size() && !satisfied; i++)
+            for(size_t j = i + 1; j < words.size() && static_cast<long>(j - i) <= distance[r] && !satisfied; j++)
+                satisfied = (words[i] == word1[r] && words[j] == word2[r]) || (words[i] == word2[r] && words[j] == word1[r]);
+        if(satisfied)
+            score++;
+    }
+    return score;
+}
+
+
+// Checks normalizeRules against referenceNormalForm, and calculateSatisfaction, calculateSatisfactionIndexed and CompiledRules::score
+// against referenceSatisfaction, on nCases random rule sets with several random documents each. Prints the first disagreement and
+// returns false if there is one.
+bool checkSatisfaction(int nCases)
+{
+    const int MAX_RULES = 40;
+    const int DOCUMENTS_PER_CASE = 8;
+    
+    mt19937 generator(nCases);
+    uniform_int_distribution<> ruleCountDistro(0, MAX_RULES);
+    
+    // A small vocabulary of short words, so that documents satisfy some rules and not others; distances reach past
+    // MAX_BITMAP_DISTANCE so that both of calculateSatisfaction's ways of checking a rule are used
+    vector<string> vocabulary = randomVocabulary(generator, 10, 4);
+    
+    char word1[MAX_RULES][MAX_WORD_LENGTH + 1];
+    char word2[MAX_RULES][MAX_WORD_LENGTH + 1];
+    int distance[MAX_RULES];
+    for(int c = 0; c < nCases; c++)
+    {
+        int nRaw = ruleCountDistro(generator);
+        randomRules(generator, vocabulary, word1, word2, distance, nRaw, MAX_DOCUMENT_LENGTH / 2);
+        map< pair<string, string>, int > expected = referenceNormalForm(word1, word2, distance, nRaw);
+        
+        // The rules in normal form may be in any order, and the words of each rule either way around
+        int nRules = normalizeRules(word1, word2, distance, nRaw);
+        map< pair<string, string>, int > normalized;
+        bool repeated = false;
+        for(int r = 0; r < nRules; r++)
+        {
+            pair<string, string> key(min(string(word1[r]), string(word2[r])), max(string(word1[r]), string(word2[r])));
+            repeated = repeated || normalized.count(key) != 0;
+            normalized[key] = distance[r];
+        }
+        if(repeated || normalized != expected)
+        {
+            cout << "checkSatisfaction: case " << c << ": normalizeRules kept " << nRules << " rules where the normal form has "
+                 << expected.size() << endl;
+            return false;
+        }
+        
+        CompiledRules compiled(word1, word2, distance, nRules);
+        for(int d = 0; d < DOCUMENTS_PER_CASE; d++)
+        {
+            string document = randomDocument(generator, vocabulary, MAX_DOCUMENT_LENGTH);
+            int reference = referenceSatisfaction(word1, word2, distance, nRules, document.c_str());
+            const char* names[] = { "calculateSatisfaction", "calculateSatisfactionIndexed", "CompiledRules::score" };
+            int scores[] = { calculateSatisfaction(word1, word2, distance, nRules, document.c_str()),
+                             calculateSatisfactionIndexed(word1, word2, distance, nRules, document.c_str()),
+                             compiled.score(document.c_str()) };
+            for(int m = 0; m < 3; m++)
+                if(scores[m] != reference)
+                {
+                    cout << "checkSatisfaction: case " << c << ": " << names[m] << " scored " << scores[m] << " where the reference scored "
+                         << reference << " on \"" << document << "\"" << endl;
+                    return false;
+                }
+        }
+    }
+    cout << "checkSatisfaction: " << nCases << " cases passed" << endl;
+    return true;
+}
+
+
+// Checks IncrementalScorer on nCases random rule sets, each with a random document that is then edited by a series of random
+// replacements. After every edit the document must match the same edit made to a plain string, and the score must match
+// CompiledRules::score and referenceSatisfaction on the whole edited document, and calculateSatisfaction too while the document
+// is short enough for it. Prints the first disagreement and returns false if there is one.
+bool checkIncrementalScorer(int nCases)
+{
+    const int MAX_RULES = 40;
+    const int EDITS_PER_CASE = 20;
+    const size_t MAX_START_LENGTH = 300;
+    
+    mt19937 generator(nCases);
+    uniform_int_distribution<> ruleCountDistro(0, MAX_RULES);
+    uniform_int_distribution<> percentDistro(0, 99);
+    uniform_int_distribution<> lengthDistro(0, 8);
+    vector<string> vocabulary = randomVocabulary(generator, 10, 4);
+    
+    char word1[MAX_RULES][MAX_WORD_LENGTH + 1];
+    char word2[MAX_RULES][MAX_WORD_LENGTH + 1];
+    int distance[MAX_RULES];
+    for(int c = 0; c < nCases; c++)
+    {
+        int nRaw = ruleCountDistro(generator);
+        randomRules(generator, vocabulary, word1, word2, distance, nRaw, MAX_DOCUMENT_LENGTH / 2);
+        int nRules = normalizeRules(word1, word2, distance, nRaw);
+        CompiledRules compiled(word1, word2, distance, nRules);
+        
+        string document = randomDocument(generator, vocabulary, MAX_START_LENGTH);
+        IncrementalScorer scorer(compiled, document);
+        for(int e = 0; e <= EDITS_PER_CASE; e++)
+        {
+            // The first pass checks the document as it was built; every later pass makes one edit first. The edits insert,
+            // delete and replace words, lone spaces and punctuation, and sometimes reach past either end of the document.
+            if(e > 0)
+            {
+                long offset = static_cast<long>(generator() % (document.size() + 3)) - 1;
+                long length = lengthDistro(generator);
+                string text;
+                int kind = percentDistro(generator);
+                if(kind < 40)
+                    text = randomDocument(generator, vocabulary, 12);
+                else if(kind < 55)
+                    text = " ";
+                else if(kind < 65)
+                    text = "X-";
+                
+                long clampedOffset = max(0L, min(offset, static_cast<long>(document.size())));
+                long clampedLength = max(0L, min(length, static_cast<long>(document.size()) - clampedOffset));
+                document.replace(clampedOffset, clampedLength, text);
+                scorer.replace(offset, length, text);
+            }
+            
+            int expected = compiled.score(document.c_str());
+            int reference = referenceSatisfaction(word1, word2, distance, nRules, document.c_str());
+            bool shortEnough = document.size() <= static_cast<size_t>(MAX_DOCUMENT_LENGTH);
+            if(scorer.document() != document || scorer.score() != expected || reference != expected ||
+               (shortEnough && calculateSatisfaction(word1, word2, distance, nRules, document.c_str()) != expected))
+            {
+                cout << "checkIncrementalScorer: case " << c << ", edit " << e << ": IncrementalScorer scored " << scorer.score()
+                     << " where CompiledRules::score scored " << expected << " and the reference scored " << reference
+                     << " on \"" << document << "\"" << endl;
+                return false;
+            }
+        }
+    }
+    cout << "checkIncrementalScorer: " << nCases << " cases passed" << endl;
+    return true;
+}
+
+
+// Times each way of scoring on random rule sets of 10, 100, ... up to maxRules rules, and prints documents per second and MB per second.
+// The raw rules include the duplicates, empty words, non-alpha characters and non-positive distances normalizeRules has to remove.
+void benchmarkSatisfaction(int maxRules)
+{
+    // Each measurement scores this many documents, drawn from a small vocabulary so that rules are satisfied often enough to matter
+    const int N_DOCUMENTS = 20000;
+    const int VOCABULARY_SIZE = 200;
+    
+    typedef chrono::steady_clock Clock;
+    mt19937 generator(maxRules);
+    vector<string> vocabulary = randomVocabulary(generator, VOCABULARY_SIZE, 8);
+    
+    vector<string> documents(N_DOCUMENTS);
+    long totalBytes = 0;
+    for(int d = 0; d < N_DOCUMENTS; d++)
+    {
+        documents[d] = randomDocument(generator, vocabulary, MAX_DOCUMENT_LENGTH);
+        totalBytes += static_cast<long>(documents[d].size());
+    }
+    
+    long long checksum = 0;
+    cout << "rules\tnormalized\tmethod\tdocs/sec\tMB/sec" << endl;
+    for(long long rawRules = 10; rawRules <= maxRules; rawRules *= 10)
+    {
+        int nRaw = static_cast<int>(rawRules);
+        unique_ptr<char[][MAX_WORD_LENGTH + 1]> word1(new char[nRaw][MAX_WORD_LENGTH + 1]);
+        unique_ptr<char[][MAX_WORD_LENGTH + 1]> word2(new char[nRaw][MAX_WORD_LENGTH + 1]);
+        vector<int> distance(nRaw);
+        randomRules(generator, vocabulary, word1.get(), word2.get(), distance.data(), nRaw, 10);
+        int nRules = normalizeRules(word1.get(), word2.get(), distance.data(), nRaw);
+        CompiledRules compiled(word1.get(), word2.get(), distance.data(), nRules);
+        
+        const char* methods[] = { "calculateSatisfaction", "calculateSatisfactionIndexed", "CompiledRules::score" };
+        const int nMethods = sizeof(methods) / sizeof(methods[0]);
+        for(int m = 0; m < nMethods; m++)
+        {
+            Clock::time_point start = Clock::now();
+            for(int d = 0; d < N_DOCUMENTS; d++)
+            {
+                const char* document = documents[d].c_str();
+                switch(m)
+                {
+                    case 0: checksum += calculateSatisfaction(word1.get(), word2.get(), distance.data(), nRules, document); break;
+                    case 1: checksum += calculateSatisfactionIndexed(word1.get(), word2.get(), distance.data(), nRules, document); break;
+                    case 2: checksum += compiled.score(document); break;
+                }
+            }
+            double seconds = chrono::duration<double>(Clock::now() - start).count();
+            cout << nRaw << "\t" << nRules << "\t" << methods[m] << "\t" << N_DOCUMENTS / seconds << "\t"
+                 << totalBytes / seconds / 1e6 << endl;
         }
-        memset(rulesWordComparison, '\0', strlen(rulesWordComparison));
-        wordCount++;
     }
     
-    // Returns either true or false based on whether a match was found
-    if(passed == true)
-        return true;
+    // Printing the checksum keeps the compiler from discarding calls whose results are otherwise unused
+    cout << "checksum " << checksum << endl;
+}
+
+
+#ifdef SATISFY_INSTRUMENT
+thread_local ScoringCounters scoringCounters;
+
+
+// Returns the time, in processor cycles where the cycle counter can be read and in steady_clock ticks otherwise
+unsigned long long instrumentClock()
+{
+#ifdef SATISFY_HAVE_RDTSC
+    return __rdtsc();
+#else
+    return static_cast<unsigned long long>(chrono::steady_clock::now().time_since_epoch().count());
+#endif
+}
+
+
+// Sets every counter of this thread back to zero
+void resetScoringCounters()
+{
+    memset(&scoringCounters, 0, sizeof(scoringCounters));
+}
+
+
+// Writes this thread's counters, along with the average per document, either as a JSON object or as lines of text
+void writeScoringCounters(ostream& out, bool asJson)
+{
+    const char* counterNames[] = { "documents", "tokens", "ruleCandidates", "windowComparisons" };
+    const unsigned long long counterValues[] = { scoringCounters.documents, scoringCounters.tokens,
+                                                 scoringCounters.ruleCandidates, scoringCounters.windowComparisons };
+    const char* stageNames[N_SCORING_STAGES] = { "filter", "tokenize", "match", "check" };
+#ifdef SATISFY_HAVE_RDTSC
+    const char* unit = "cycles";
+#else
+    const char* unit = "ticks";
+#endif
+    double perDocument = (scoringCounters.documents == 0 ? 0 : 1.0 / scoringCounters.documents);
+    
+    if(asJson)
+    {
+        out << "{";
+        for(int c = 0; c < 4; c++)
+            out << "\"" << counterNames[c] << "\": " << counterValues[c] << ", ";
+        out << "\"unit\": \"" << unit << "\", \"stages\": {";
+        for(int stage = 0; stage < N_SCORING_STAGES; stage++)
+            out << (stage == 0 ? "" : ", ") << "\"" << stageNames[stage] << "\": {\"total\": " << scoringCounters.ticks[stage]
+                << ", \"perDocument\": " << scoringCounters.ticks[stage] * perDocument << "}";
+        out << "}}" << endl;
+    }
     else
-        return false;
+    {
+        for(int c = 0; c < 4; c++)
+            out << counterNames[c] << "\t" << counterValues[c] << endl;
+        for(int stage = 0; stage < N_SCORING_STAGES; stage++)
+            out << stageNames[stage] << "\t" << scoringCounters.ticks[stage] << " " << unit << "\t"
+                << scoringCounters.ticks[stage] * perDocument << " " << unit << "/document" << endl;
+    }
 }
+#endif
@@ -6,6 +6,9 @@
 #include <utility>
 #include <cstdlib>
 #include <cctype>
+#include <vector>
+#include <mutex>
+#include <chrono>
 using namespace std;
 
 ///////////////////////////////////////////////////////////////////////////
@@ -16,6 +19,9 @@ const int MAXROWS = 20;            // max number of rows in the arena
 const int MAXCOLS = 20;            // max number of columns in the arena
 const int MAXRATS = 100;           // max number of rats allowed
 
+const int MAXARENAROWS = 8192;     // max number of rows in an arena built for a simulation
+const int MAXARENACOLS = 8192;     // max number of columns in an arena built for a simulation
+
 const int NORTH = 0;
 const int EAST  = 1;
 const int SOUTH = 2;
@@ -38,6 +44,24 @@ const int NO_ATTEMPT  = 1;          // A rat that ate one pellet moved last turn
 
 class Arena;
 
+// A small, fast generator of random numbers (xoshiro128**), with 16 bytes of state, so each
+// thread and each arena can cheaply have its own
+class RandomEngine
+{
+public:
+    // Constructor
+    RandomEngine(unsigned long long seed);
+    
+    // Mutators
+    void     seed(unsigned long long seed);
+    unsigned next();
+    int      nextInt(int min, int max);
+    void     fillDirections(unsigned char dirs[], int n);
+    
+private:
+    unsigned m_state[4];
+};
+
 class Rat
 {
 public:
@@ -53,7 +77,12 @@ public:
     void move();
     
 private:
+    // A view of one of the rats the arena itself keeps, which only the arena can make
+    friend class Arena;
+    Rat(Arena* ap, int index);
+    
     Arena* m_arena;
+    int    m_index;         // the arena's number for the rat this views, or -1 for a rat of its own
     int    m_row;
     int    m_col;
     int    m_ratHealth;
@@ -76,6 +105,10 @@ public:
     string move(int dir);
     void   setDead();
     
+    // The same moves without building a message, for games that are not displayed
+    bool   placePoisonPellet();
+    bool   step(int dir);
+    
 private:
     Arena* m_arena;
     int    m_row;
@@ -87,7 +120,7 @@ class Arena
 {
 public:
     // Constructor/destructor
-    Arena(int nRows, int nCols);
+    Arena(int nRows, int nCols, int maxRats = MAXRATS);
     ~Arena();
     
     // Accessors
@@ -95,8 +128,12 @@ public:
     int     cols() const;
     Player* player() const;
     int     ratCount() const;
+    int     turns() const;
     int     getCellStatus(int r, int c) const;
     int     numberOfRatsAt(int r, int c) const;
+    int     ratRow(int i) const;
+    int     ratCol(int i) const;
+    bool    ratIsDead(int i) const;
     void    display(string msg) const;
     
     // Mutators
@@ -104,19 +141,49 @@ public:
     bool addRat(int r, int c);
     bool addPlayer(int r, int c);
     void moveRats();
+    void moveRat(int i, int dir);
+    Rat  rat(int i);
+    void seedRandom(unsigned long long seed);
     
 private:
-    int     m_grid[MAXROWS][MAXCOLS];
-    int     m_rows;
-    int     m_cols;
-    Player* m_player;
-    Rat*    m_rats[MAXRATS];
-    int     m_nRats;
-    int     m_turns;
+    // The cells are stored row by row, one after another
+    vector<unsigned char> m_grid;       // EMPTY or HAS_POISON for each cell
+    vector<int>           m_ratCounts;  // number of live rats in each cell
+    int                   m_rows;
+    int                   m_cols;
+    Player*               m_player;
+    
+    // The rats are stored as one array per field, indexed by rat, so moving them all is one pass over
+    // small packed values; a dead rat is removed by moving the last rat into its place
+    vector<unsigned short> m_ratRows;
+    vector<unsigned short> m_ratCols;
+    vector<unsigned char>  m_ratHealth;
+    vector<unsigned char>  m_ratMoveLastTurn;
+    int                   m_nRats;
+    int                   m_maxRats;
+    int                   m_turns;
+    
+    // The arena's own random numbers, and the directions drawn from them for each turn
+    RandomEngine          m_random;
+    vector<unsigned char> m_directions;
     
     // Helper functions
     void checkPos(int r, int c) const;
     bool isPosInBounds(int r, int c) const;
+    int  cellIndex(int r, int c) const;
+};
+
+// Chooses the player's move at (r,c): a true return means move in the direction dir is set
+// to, and a false return means drop a poison pellet; recommendMove is one such policy
+typedef bool (*PlayerPolicy)(const Arena& a, int r, int c, int& dir);
+
+// How a game played without a display ended
+struct GameResult
+{
+    bool won;           // every rat died before the player did
+    bool finished;      // the game ended before reaching the turn limit
+    int  turns;
+    int  ratsKilled;
 };
 
 class Game
@@ -127,7 +194,8 @@ public:
     ~Game();
     
     // Mutators
-    void play();
+    void       play();
+    GameResult playHeadless(PlayerPolicy policy, int maxTurns);
     
 private:
     Arena* m_arena;
@@ -141,13 +209,99 @@ private:
 ///////////////////////////////////////////////////////////////////////////
 
 int  randInt(int min, int max);
+RandomEngine& threadRandomEngine();
+unsigned long long randomSeed();
 bool decodeDirection(char ch, int& dir);
 bool attemptMove(const Arena& a, int dir, int& r, int& c);
+void takeRatTurn(Arena& a, int dir, int& r, int& c, int& health, int& moveLastTurn);
 bool checkMove(const Arena& a, int dir, int r, int c);
 int  checkRats(const Arena& a, int dir, int r, int c);
 bool recommendMove(const Arena& a, int r, int c, int& bestDir);
+void simulateGames(int nGames, int rows, int cols, int nRats, PlayerPolicy policy);
 void clearScreen();
 
+///////////////////////////////////////////////////////////////////////////
+//  RandomEngine implementation
+///////////////////////////////////////////////////////////////////////////
+
+RandomEngine::RandomEngine(unsigned long long seed)
+{
+    this->seed(seed);
+}
+
+// Spreads a 64 bit seed over the whole state with splitmix64, so that similar seeds
+// still give unrelated sequences and the state is never all zero
+void RandomEngine::seed(unsigned long long seed)
+{
+    for (int i = 0; i < 4; i += 2)
+    {
+        seed += 0x9E3779B97F4A7C15ULL;
+        unsigned long long z = seed;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        z ^= z >> 31;
+        m_state[i] = static_cast<unsigned>(z);
+        m_state[i+1] = static_cast<unsigned>(z >> 32);
+    }
+}
+
+// Returns 32 random bits
+unsigned RandomEngine::next()
+{
+    unsigned x = m_state[1] * 5;
+    unsigned result = ((x << 7) | (x >> 25)) * 9;
+    unsigned t = m_state[1] << 9;
+    
+    m_state[2] ^= m_state[0];
+    m_state[3] ^= m_state[1];
+    m_state[1] ^= m_state[2];
+    m_state[0] ^= m_state[3];
+    m_state[2] ^= t;
+    m_state[3] = (m_state[3] << 11) | (m_state[3] >> 21);
+    return result;
+}
+
+// Returns a uniformly distributed random int from min to max, inclusive. The range is scaled
+// with one multiplication (Lemire's method), and the rare draws that would favor some values
+// over others are thrown away, which costs a division only when such a draw might occur.
+int RandomEngine::nextInt(int min, int max)
+{
+    if (max < min)
+        swap(max, min);
+    unsigned long long range = static_cast<unsigned long long>(static_cast<long long>(max) - min) + 1;
+    if (range > 0xFFFFFFFFULL)
+        return static_cast<int>(next());
+    
+    unsigned long long product = next() * range;
+    unsigned low = static_cast<unsigned>(product);
+    if (low < range)
+    {
+        unsigned threshold = static_cast<unsigned>((0x100000000ULL - range) % range);
+        while (low < threshold)
+        {
+            product = next() * range;
+            low = static_cast<unsigned>(product);
+        }
+    }
+    return static_cast<int>(min + static_cast<long long>(product >> 32));
+}
+
+// Fills dirs with n random directions. NUMDIRS is a power of two, so each 32 bit draw
+// gives 16 unbiased directions of 2 bits each.
+void RandomEngine::fillDirections(unsigned char dirs[], int n)
+{
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        unsigned bits = next();
+        for (int j = 0; j < 16; j++, bits >>= 2)
+            dirs[i+j] = static_cast<unsigned char>(bits & (NUMDIRS - 1));
+    }
+    unsigned bits = next();
+    for (; i < n; i++, bits >>= 2)
+        dirs[i] = static_cast<unsigned char>(bits & (NUMDIRS - 1));
+}
+
 ///////////////////////////////////////////////////////////////////////////
 //  Rat implementation
 ///////////////////////////////////////////////////////////////////////////
@@ -166,24 +320,43 @@ Rat::Rat(Arena* ap, int r, int c)
         exit(1);
     }
     m_arena = ap;
+    m_index = -1;
     m_row = r;
     m_col = c;
     m_ratHealth = RAT_FINE;
     m_moveLastTurn = YES_ATTEMPT;
 }
 
+// A view of rat number index of an arena; it reads and moves the arena's own copy of the
+// rat, and is only good until the arena next removes dead rats
+Rat::Rat(Arena* ap, int index)
+{
+    m_arena = ap;
+    m_index = index;
+    m_row = 0;
+    m_col = 0;
+    m_ratHealth = RAT_FINE;
+    m_moveLastTurn = YES_ATTEMPT;
+}
+
 int Rat::row() const
 {
+    if (m_index >= 0)
+        return m_arena->ratRow(m_index);
     return m_row;
 }
 
 int Rat::col() const
 {
+    if (m_index >= 0)
+        return m_arena->ratCol(m_index);
     return m_col;
 }
 
 bool Rat::isDead() const
 {
+    if (m_index >= 0)
+        return m_arena->ratIsDead(m_index);
     if(m_ratHealth == RAT_DEAD)
         return true;
     return false;
@@ -194,29 +367,12 @@ void Rat::move()
     //  Generates a random position to move in
     int dir = randInt(NORTH, WEST);
     
-    // Determines whether rat should move or not based on whether it already ate a pellet
-    // and, if applicable, whether it attempted to move on the last turn
-    if (m_ratHealth == RAT_SLOW)
-    {
-        if (m_moveLastTurn == YES_ATTEMPT)
-        {
-            attemptMove(*m_arena, dir, m_row, m_col);
-            m_moveLastTurn = NO_ATTEMPT;
-        }
-        else if (m_moveLastTurn == NO_ATTEMPT)
-            m_moveLastTurn = YES_ATTEMPT;
-    }
-    else if (m_ratHealth == RAT_FINE)
-        attemptMove(*m_arena, dir, m_row, m_col);
-    
-    // Checks if pellet is at position and if so, eats it and clears the pellet
-    if (m_arena->getCellStatus(m_row, m_col) == HAS_POISON)
-    {
-        if (m_ratHealth == RAT_FINE)
-            m_moveLastTurn = NO_ATTEMPT;
-        m_ratHealth++;
-        m_arena->setCellStatus(m_row, m_col, EMPTY);
-    }
+    // A view moves the arena's rat, which keeps the arena's counts up to date; a rat of
+    // its own is not in the arena's counts
+    if (m_index >= 0)
+        m_arena->moveRat(m_index, dir);
+    else
+        takeRatTurn(*m_arena, dir, m_row, m_col, m_ratHealth, m_moveLastTurn);
 }
 
 ///////////////////////////////////////////////////////////////////////////
@@ -254,21 +410,17 @@ int Player::col() const
 
 string Player::dropPoisonPellet()
 {
-    if (m_arena->getCellStatus(m_row, m_col) == HAS_POISON)
+    if (! placePoisonPellet())
         return "There's already a poison pellet at this spot.";
-    m_arena->setCellStatus(m_row, m_col, HAS_POISON);
     return "A poison pellet has been dropped.";
 }
 
 string Player::move(int dir)
 {
-    if (!attemptMove(*m_arena, dir, m_row, m_col))
+    if (! step(dir))
         return "Player couldn't move; player stands.";
-    else if (m_arena->numberOfRatsAt(m_row, m_col) > 0)
-    {
-        setDead();
+    else if (isDead())
         return "Player walked into a rat and died.";
-    }
     else if (dir == NORTH)
         return "Player moved north.";
     else if (dir == EAST)
@@ -293,33 +445,59 @@ void Player::setDead()
     m_dead = true;
 }
 
+// Drops a poison pellet where the player stands, returning false if one is already there
+bool Player::placePoisonPellet()
+{
+    if (m_arena->getCellStatus(m_row, m_col) == HAS_POISON)
+        return false;
+    m_arena->setCellStatus(m_row, m_col, HAS_POISON);
+    return true;
+}
+
+// Moves the player one step, returning false if that would leave the arena; a player
+// who steps onto a rat dies
+bool Player::step(int dir)
+{
+    if (!attemptMove(*m_arena, dir, m_row, m_col))
+        return false;
+    if (m_arena->numberOfRatsAt(m_row, m_col) > 0)
+        setDead();
+    return true;
+}
+
 ///////////////////////////////////////////////////////////////////////////
 //  Arena implementation
 ///////////////////////////////////////////////////////////////////////////
 
-Arena::Arena(int nRows, int nCols)
+// An arena of any size up to MAXARENAROWS by MAXARENACOLS holding up to maxRats rats;
+// the game itself keeps to MAXROWS by MAXCOLS and MAXRATS
+Arena::Arena(int nRows, int nCols, int maxRats)
+ : m_random(randomSeed())
 {
-    if (nRows <= 0  ||  nCols <= 0  ||  nRows > MAXROWS  ||  nCols > MAXCOLS)
+    if (nRows <= 0  ||  nCols <= 0  ||  nRows > MAXARENAROWS  ||  nCols > MAXARENACOLS)
     {
         cout << "***** Arena created with invalid size " << nRows << " by "
         << nCols << "!" << endl;
         exit(1);
     }
+    if (maxRats < 0)
+    {
+        cout << "***** Arena created with negative maximum of " << maxRats << " rats!" << endl;
+        exit(1);
+    }
     m_rows = nRows;
     m_cols = nCols;
     m_player = nullptr;
     m_nRats = 0;
+    m_maxRats = maxRats;
     m_turns = 0;
-    for (int r = 1; r <= m_rows; r++)
-        for (int c = 1; c <= m_cols; c++)
-            setCellStatus(r, c, EMPTY);
+    m_grid.assign(m_rows * m_cols, EMPTY);
+    m_ratCounts.assign(m_rows * m_cols, 0);
 }
 
 Arena::~Arena()
 {
     delete m_player;
-    for (int i = 0; i < ratCount(); i++)
-        delete m_rats[i];
 }
 
 int Arena::rows() const
@@ -342,32 +520,50 @@ int Arena::ratCount() const
     return m_nRats;
 }
 
+int Arena::turns() const
+{
+    return m_turns;
+}
+
 int Arena::getCellStatus(int r, int c) const
 {
     checkPos(r, c);
-    return m_grid[r-1][c-1];
+    return m_grid[cellIndex(r, c)];
 }
 
+// Looks up the number of live rats at a position in the count kept for each cell, so it
+// takes the same time however many rats there are; positions off the arena have none
 int Arena::numberOfRatsAt(int r, int c) const
 {
-    int count = 0;
-    for (int i = 0; i < ratCount(); i++)
-    {
-        if (m_rats[i]->row() == r && m_rats[i]->col() == c && ! m_rats[i]->isDead())
-            count++;
-    }
-    return count;
+    if (! isPosInBounds(r, c))
+        return 0;
+    return m_ratCounts[cellIndex(r, c)];
+}
+
+int Arena::ratRow(int i) const
+{
+    return m_ratRows[i];
+}
+
+int Arena::ratCol(int i) const
+{
+    return m_ratCols[i];
+}
+
+bool Arena::ratIsDead(int i) const
+{
+    return m_ratHealth[i] == RAT_DEAD;
 }
 
 void Arena::display(string msg) const
 {
-    char displayGrid[MAXROWS][MAXCOLS];
+    vector<char> displayGrid(m_grid.size());
     int r, c;
     
     // Fill displayGrid with dots (empty) and stars (poison pellets)
     for (r = 1; r <= rows(); r++)
         for (c = 1; c <= cols(); c++)
-            displayGrid[r-1][c-1] = (getCellStatus(r,c) == EMPTY ? '.' : '*');
+            displayGrid[cellIndex(r, c)] = (getCellStatus(r,c) == EMPTY ? '.' : '*');
     
     // Indicate each rat's position
     for (r = 1; r <= rows(); r++)
@@ -375,27 +571,26 @@ void Arena::display(string msg) const
             if(numberOfRatsAt(r, c) != 0)
                 switch(numberOfRatsAt(r, c))
                 {
-                    case 1: displayGrid[r-1][c-1] = 'R'; break;
-                    case 2: displayGrid[r-1][c-1] = '2'; break;
-                    case 3: displayGrid[r-1][c-1] = '3'; break;
-                    case 4: displayGrid[r-1][c-1] = '4'; break;
-                    case 5: displayGrid[r-1][c-1] = '5'; break;
-                    case 6: displayGrid[r-1][c-1] = '6'; break;
-                    case 7: displayGrid[r-1][c-1] = '7'; break;
-                    case 8: displayGrid[r-1][c-1] = '8'; break;
-                    default: displayGrid[r-1][c-1] = '9';
+                    case 1: displayGrid[cellIndex(r, c)] = 'R'; break;
+                    case 2: displayGrid[cellIndex(r, c)] = '2'; break;
+                    case 3: displayGrid[cellIndex(r, c)] = '3'; break;
+                    case 4: displayGrid[cellIndex(r, c)] = '4'; break;
+                    case 5: displayGrid[cellIndex(r, c)] = '5'; break;
+                    case 6: displayGrid[cellIndex(r, c)] = '6'; break;
+                    case 7: displayGrid[cellIndex(r, c)] = '7'; break;
+                    case 8: displayGrid[cellIndex(r, c)] = '8'; break;
+                    default: displayGrid[cellIndex(r, c)] = '9';
                 }
     
     // Indicate player's position
     if (m_player != nullptr)
-        displayGrid[m_player->row()-1][m_player->col()-1] = (m_player->isDead() ? 'X' : '@');
+        displayGrid[cellIndex(m_player->row(), m_player->col())] = (m_player->isDead() ? 'X' : '@');
     
     // Draw the grid
     clearScreen();
     for (r = 1; r <= rows(); r++)
     {
-        for (c = 1; c <= cols(); c++)
-            cout << displayGrid[r-1][c-1];
+        cout.write(&displayGrid[cellIndex(r, 1)], cols());
         cout << endl;
     }
     cout << endl;
@@ -414,7 +609,7 @@ void Arena::display(string msg) const
 void Arena::setCellStatus(int r, int c, int status)
 {
     checkPos(r, c);
-    m_grid[r-1][c-1] = status;
+    m_grid[cellIndex(r, c)] = static_cast<unsigned char>(status);
 }
 
 bool Arena::addRat(int r, int c)
@@ -431,11 +626,15 @@ bool Arena::addRat(int r, int c)
         return false;
     
     // Don't add more rats than the maximum
-    if(ratCount() == MAXRATS)
+    if(ratCount() == m_maxRats)
         return false;
     
-    m_rats[ratCount()] = new Rat(this, r, c);
+    m_ratRows.push_back(static_cast<unsigned short>(r));
+    m_ratCols.push_back(static_cast<unsigned short>(c));
+    m_ratHealth.push_back(RAT_FINE);
+    m_ratMoveLastTurn.push_back(YES_ATTEMPT);
     m_nRats++;
+    m_ratCounts[cellIndex(r, c)]++;
     return true;
 }
 
@@ -458,48 +657,85 @@ bool Arena::addPlayer(int r, int c)
 
 void Arena::moveRats()
 {
-    // Randomly moves each rat
+    // Randomly moves each rat, drawing all of the turn's directions at once
+    m_directions.resize(m_nRats);
+    m_random.fillDirections(m_directions.data(), m_nRats);
     for (int i = 0; i < ratCount(); i++)
-        m_rats[i]->move();
+        moveRat(i, m_directions[i]);
     
     // Checks if any rats moved onto the player's position and if so, kills the player
-    if (numberOfRatsAt(m_player->row(), m_player->col()) > 0)
+    if (m_player != nullptr  &&  numberOfRatsAt(m_player->row(), m_player->col()) > 0)
         m_player->setDead();
     
-    // Save number of rats for future use
-    const int counter = m_nRats;
-    
-    // Checks if any rats died, and if so sets the last element of the m_rats array
-    // pointing to that rat, so that it can be deleted
-    int temp = ratCount() - 1;
-    for (int i = 0; i < ratCount(); i++)
+    // Removes each dead rat by moving the last rat into its place, then checking that rat in turn
+    for (int i = 0; i < m_nRats; )
     {
-        Rat* holder = nullptr;
-        if (m_rats[i]->isDead())
+        if (m_ratHealth[i] != RAT_DEAD)
         {
-            holder = m_rats[i];
-            m_rats[i] = m_rats[temp];
-            m_rats[temp] = holder;
-            holder = nullptr;
-            temp--;
-            m_nRats--;
-            i--;
+            i++;
+            continue;
         }
+        m_nRats--;
+        m_ratRows[i] = m_ratRows[m_nRats];
+        m_ratCols[i] = m_ratCols[m_nRats];
+        m_ratHealth[i] = m_ratHealth[m_nRats];
+        m_ratMoveLastTurn[i] = m_ratMoveLastTurn[m_nRats];
     }
-    
-    // Deletes all nullptrs
-    for (int a = counter - 1; a > m_nRats - 1; a--)
-        delete m_rats[a];
+    m_ratRows.resize(m_nRats);
+    m_ratCols.resize(m_nRats);
+    m_ratHealth.resize(m_nRats);
+    m_ratMoveLastTurn.resize(m_nRats);
 
     // Another turn has been taken
     m_turns++;
 }
 
+// Moves rat number i one turn in a direction, keeping the count of rats in each cell up to date
+void Arena::moveRat(int i, int dir)
+{
+    int r = m_ratRows[i];
+    int c = m_ratCols[i];
+    int health = m_ratHealth[i];
+    int moveLastTurn = m_ratMoveLastTurn[i];
+    
+    // A dead rat stays where it is and is no longer counted
+    if (health == RAT_DEAD)
+        return;
+    
+    takeRatTurn(*this, dir, r, c, health, moveLastTurn);
+    m_ratCounts[cellIndex(m_ratRows[i], m_ratCols[i])]--;
+    if (health != RAT_DEAD)
+        m_ratCounts[cellIndex(r, c)]++;
+    
+    m_ratRows[i] = static_cast<unsigned short>(r);
+    m_ratCols[i] = static_cast<unsigned short>(c);
+    m_ratHealth[i] = static_cast<unsigned char>(health);
+    m_ratMoveLastTurn[i] = static_cast<unsigned char>(moveLastTurn);
+}
+
+// Returns a view of rat number i, which is good until moveRats next removes dead rats
+Rat Arena::rat(int i)
+{
+    return Rat(this, i);
+}
+
+// Restarts the arena's random numbers from a seed, so that the rats' moves can be repeated
+void Arena::seedRandom(unsigned long long seed)
+{
+    m_random.seed(seed);
+}
+
 bool Arena::isPosInBounds(int r, int c) const
 {
     return (r >= 1  &&  r <= m_rows  &&  c >= 1  &&  c <= m_cols);
 }
 
+// Returns where the cell at a position is stored in the arena's row by row arrays
+int Arena::cellIndex(int r, int c) const
+{
+    return (r-1) * m_cols + (c-1);
+}
+
 void Arena::checkPos(int r, int c) const
 {
     if (r < 1  ||  r > m_rows  ||  c < 1  ||  c > m_cols)
@@ -521,6 +757,12 @@ Game::Game(int rows, int cols, int nRats)
         cout << "***** Cannot create Game with negative number of rats!" << endl;
         exit(1);
     }
+    if (rows > MAXROWS  ||  cols > MAXCOLS)
+    {
+        cout << "***** Arena created with invalid size " << rows << " by "
+        << cols << "!" << endl;
+        exit(1);
+    }
     if (nRats > MAXRATS)
     {
         cout << "***** Trying to create Game with " << nRats
@@ -613,6 +855,33 @@ void Game::play()
         cout << "You win." << endl;
 }
 
+// Plays the game with the player's moves chosen by a policy instead of typed in, showing
+// nothing, until the player or every rat dies or maxTurns turns have been taken
+GameResult Game::playHeadless(PlayerPolicy policy, int maxTurns)
+{
+    const int startingRats = m_arena->ratCount();
+    Player* player = m_arena->player();
+    
+    while ( ! player->isDead()  &&  m_arena->ratCount() > 0  &&  m_arena->turns() < maxTurns)
+    {
+        int dir;
+        if (policy(*m_arena, player->row(), player->col(), dir))
+            player->step(dir);
+        else
+            player->placePoisonPellet();
+        if (player->isDead())
+            break;
+        m_arena->moveRats();
+    }
+    
+    GameResult result;
+    result.won = ! player->isDead()  &&  m_arena->ratCount() == 0;
+    result.finished = player->isDead()  ||  m_arena->ratCount() == 0;
+    result.turns = m_arena->turns();
+    result.ratsKilled = startingRats - m_arena->ratCount();
+    return result;
+}
+
 ///////////////////////////////////////////////////////////////////////////
 //  Auxiliary function implementation
 ///////////////////////////////////////////////////////////////////////////
@@ -620,12 +889,52 @@ void Game::play()
 // Return a uniformly distributed random int from min to max, inclusive
 int randInt(int min, int max)
 {
-    if (max < min)
-        swap(max, min);
+    return threadRandomEngine().nextInt(min, max);
+}
+
+// Returns this thread's own random number generator, so threads never share one
+RandomEngine& threadRandomEngine()
+{
+    thread_local RandomEngine engine(randomSeed());
+    return engine;
+}
+
+// Returns a seed from the system's source of random numbers
+unsigned long long randomSeed()
+{
     static random_device rd;
-    static mt19937 generator(rd());
-    uniform_int_distribution<> distro(min, max);
-    return distro(generator);
+    static mutex rdMutex;
+    lock_guard<mutex> lock(rdMutex);
+    return (static_cast<unsigned long long>(rd()) << 32) ^ rd();
+}
+
+// Moves a rat at (r,c) one turn in the indicated direction: a rat that has eaten one pellet
+// only moves every other turn, and a rat that ends on a pellet eats it and clears it
+void takeRatTurn(Arena& a, int dir, int& r, int& c, int& health, int& moveLastTurn)
+{
+    // Determines whether rat should move or not based on whether it already ate a pellet
+    // and, if applicable, whether it attempted to move on the last turn
+    if (health == RAT_SLOW)
+    {
+        if (moveLastTurn == YES_ATTEMPT)
+        {
+            attemptMove(a, dir, r, c);
+            moveLastTurn = NO_ATTEMPT;
+        }
+        else if (moveLastTurn == NO_ATTEMPT)
+            moveLastTurn = YES_ATTEMPT;
+    }
+    else if (health == RAT_FINE)
+        attemptMove(a, dir, r, c);
+    
+    // Checks if pellet is at position and if so, eats it and clears the pellet
+    if (a.getCellStatus(r, c) == HAS_POISON)
+    {
+        if (health == RAT_FINE)
+            moveLastTurn = NO_ATTEMPT;
+        health++;
+        a.setCellStatus(r, c, EMPTY);
+    }
 }
 
 // Returns true if the indicated direction is valid and sets an integer to that direction
@@ -1007,11 +1316,52 @@ bool recommendMove(const Arena& a, int r, int c, int& bestDir)
     return false;
 }
 
+// Plays nGames games without a display, with the player's moves chosen by a policy, and
+// reports how many were won and lost, the turns and rats killed, and the turns per second
+void simulateGames(int nGames, int rows, int cols, int nRats, PlayerPolicy policy)
+{
+    // A game that runs this long is stopped and counted as unfinished
+    const int MAX_TURNS = 100000;
+    
+    int wins = 0;
+    int losses = 0;
+    int unfinished = 0;
+    long long totalTurns = 0;
+    long long totalKilled = 0;
+    
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int i = 0; i < nGames; i++)
+    {
+        Game g(rows, cols, nRats);
+        GameResult result = g.playHeadless(policy, MAX_TURNS);
+        if (result.won)
+            wins++;
+        else if (result.finished)
+            losses++;
+        else
+            unfinished++;
+        totalTurns += result.turns;
+        totalKilled += result.ratsKilled;
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    
+    cout << nGames << " games: " << wins << " won, " << losses << " lost, "
+    << unfinished << " unfinished" << endl;
+    cout << totalTurns << " turns (" << (nGames > 0 ? double(totalTurns) / nGames : 0)
+    << " per game), " << totalKilled << " rats killed" << endl;
+    cout << seconds << " seconds, " << (seconds > 0 ? totalTurns / seconds : 0) << " turns per second" << endl;
+}
+
 ///////////////////////////////////////////////////////////////////////////
 // main()
 ///////////////////////////////////////////////////////////////////////////
+// The graded program supplies its own main; building with -DRATS_SIMULATE instead plays games on the standard
+// arena without a display, with the player's moves chosen by recommendMove
 int main()
 {
+#ifdef RATS_SIMULATE
+    simulateGames(2000, MAXROWS, MAXCOLS, MAXRATS, recommendMove);
+#endif
 }
 
 ///////////////////////////////////////////////////////////////////////////